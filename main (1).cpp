@@ -1,12 +1,38 @@
 #include <cmath>
 #include <iostream>
+#include <fstream>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <queue>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CALC_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#else
+#define CALC_X86 0
+#endif
+// switch 中有意落到下一个 case；C++11 没有 [[fallthrough]]
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define CALC_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define CALC_FALLTHROUGH ((void)0)
+#endif
 
 // ============================================
 // 内存管理系统
@@ -185,218 +211,3539 @@ MemoryManager* MemoryManager::instance = nullptr;
 // 如果需要全局监控，可以使用下面的替代方案
 // 但会大幅降低性能
 
+// ============================================
+// 大整数基础设施
+// ============================================
+
+// 大整数采用 64 位二进制“肢”(limb)存储，小端序：d[0] 为最低位。
+// 规范形式下最高肢不为 0，数值 0 用空向量表示。
+// 相比旧版每个 int 只存一位十进制数字，内存约为原来的 1/8，
+// 循环次数也少了一个数量级。
+typedef std::uint64_t limb;
+typedef unsigned __int128 dlimb;
+
+const int LIMB_BITS = 64;
+
+// 带内联缓冲的肢数组：不超过 LIMB_INLINE 个肢时直接存在对象内部，超出才到堆上分配。
+// 计算器里绝大多数操作数不到 40 位十进制(两个肢)，连同加法多出的一肢、
+// 两肢乘两肢得到的四肢都放得下，小数字的整条计算路径不碰堆。
+// 接口只实现了 std::vector 中本程序用到的部分，语义与之相同(resize 新增的肢填 0)。
+const size_t LIMB_INLINE = 4;
+
+class LimbVec
+{
+public:
+    typedef limb value_type;
+    typedef limb* iterator;
+    typedef const limb* const_iterator;
+
+    LimbVec() : p(buf), n(0), cap(LIMB_INLINE) {}
+    explicit LimbVec(size_t k) : p(buf), n(0), cap(LIMB_INLINE) { resize(k); }
+    LimbVec(const LimbVec& o) : p(buf), n(0), cap(LIMB_INLINE) { assign(o.begin(), o.end()); }
+    LimbVec(LimbVec&& o) noexcept : p(buf), n(0), cap(LIMB_INLINE) { steal(o); }
+    ~LimbVec() { release(); }
+
+    LimbVec& operator=(const LimbVec& o)
+    {
+        if (this != &o) assign(o.begin(), o.end());
+        return *this;
+    }
+
+    LimbVec& operator=(LimbVec&& o) noexcept
+    {
+        if (this != &o)
+        {
+            release();
+            p = buf;
+            n = 0;
+            cap = LIMB_INLINE;
+            steal(o);
+        }
+        return *this;
+    }
+
+    size_t size() const { return n; }
+    size_t capacity() const { return cap; }
+    bool empty() const { return n == 0; }
+
+    limb* data() { return p; }
+    const limb* data() const { return p; }
+    limb& operator[](size_t i) { return p[i]; }
+    const limb& operator[](size_t i) const { return p[i]; }
+    limb& back() { return p[n - 1]; }
+    const limb& back() const { return p[n - 1]; }
+
+    iterator begin() { return p; }
+    iterator end() { return p + n; }
+    const_iterator begin() const { return p; }
+    const_iterator end() const { return p + n; }
+
+    void clear() { n = 0; }
+    void pop_back() { n--; }
+
+    void push_back(limb v)
+    {
+        if (n == cap) grow(2 * n + LIMB_INLINE);
+        p[n++] = v;
+    }
+
+    void reserve(size_t k)
+    {
+        if (k > cap) grow(k);
+    }
+
+    void resize(size_t k, limb v = 0)
+    {
+        if (k > cap) grow(std::max(k, cap + cap / 2));
+        if (k > n) std::fill(p + n, p + k, v);
+        n = k;
+    }
+
+    void assign(size_t k, limb v)
+    {
+        n = 0;
+        resize(k, v);
+    }
+
+    // 源区间可以落在自身内部(先搬数据再改长度，且不会在拷贝途中扩容)
+    void assign(const limb* first, const limb* last)
+    {
+        size_t k = last - first;
+        if (k > cap)
+        {
+            LimbVec t;
+            t.grow(k);
+            std::copy(first, last, t.p);
+            t.n = k;
+            *this = std::move(t);
+            return;
+        }
+        std::copy(first, last, p);
+        n = k;
+    }
+
+    void swap(LimbVec& o)
+    {
+        if (p != buf && o.p != o.buf)
+        {
+            std::swap(p, o.p);
+            std::swap(n, o.n);
+            std::swap(cap, o.cap);
+            return;
+        }
+        LimbVec t(std::move(o));
+        o = std::move(*this);
+        *this = std::move(t);
+    }
+
+private:
+    limb* p;
+    size_t n, cap;
+    limb buf[LIMB_INLINE];
+
+    void grow(size_t k)
+    {
+        limb* q = new limb[k];
+        std::copy(p, p + n, q);
+        release();
+        p = q;
+        cap = k;
+    }
+
+    void release()
+    {
+        if (p != buf) delete[] p;
+    }
+
+    // o 在堆上时直接接管指针，否则复制内联的几个肢；调用前自身必须为空的内联状态
+    void steal(LimbVec& o)
+    {
+        if (o.p != o.buf)
+        {
+            p = o.p;
+            cap = o.cap;
+            o.p = o.buf;
+            o.cap = LIMB_INLINE;
+        }
+        else
+        {
+            std::copy(o.buf, o.buf + o.n, buf);
+        }
+        n = o.n;
+        o.n = 0;
+    }
+};
+
+struct BigInt
+{
+    LimbVec d;
+    bool neg;   // 符号位，d 存绝对值；数值 0 的 neg 恒为 false
+
+    BigInt() : neg(false) {}
+    explicit BigInt(limb v) : neg(false) { if (v) d.push_back(v); }
+
+    bool isZero() const { return d.empty(); }
+    size_t size() const { return d.size(); }
+};
+
+// 去掉高位的 0 肢
+void trim(BigInt& a)
+{
+    while (!a.d.empty() && a.d.back() == 0) a.d.pop_back();
+    if (a.d.empty()) a.neg = false;
+}
+
+size_t bit_length(const BigInt& a)
+{
+    if (a.isZero()) return 0;
+    size_t n = (a.size() - 1) * LIMB_BITS;
+    for (limb top = a.d.back(); top; top >>= 1) n++;
+    return n;
+}
+
+// ---------- 肢数组底层运算 ----------
+// 以下函数直接操作肢数组，长度由调用者保证，返回值为进位/借位/余数。
+
+int cmp_n(const limb* a, const limb* b, size_t n)
+{
+    while (n-- > 0)
+    {
+        if (a[n] != b[n]) return a[n] > b[n] ? 1 : -1;
+    }
+    return 0;
+}
+
+// ---------- 加减法向量化内核 ----------
+// 先整块算出各肢的和(差)，再由每个肢“产生进位”和“传递进位”的位掩码一次性求出所有进位：
+// 把掩码当作整数，t = (产生 << 1) + 传递 + 进位输入，则 t ^ 传递 的第 i 位就是进入第 i 个肢的进位，
+// 高出的那一位是整块的进位输出。这样进位链从逐肢的数据依赖变成了一次整数加法。
+// 以下内核都带进位(借位)输入 c，返回进位(借位)输出。
+// 各指令集版本用 target 属性单独编译，运行时再按 CPU 支持情况选用，见后面的“运行时内核分派”。
+
+limb add_nc_scalar(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        limb s = a[i] + c;
+        c = s < c;
+        limb t = s + b[i];
+        c += t < s;
+        r[i] = t;
+    }
+    return c;
+}
+
+limb sub_nc_scalar(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        limb s = a[i] - b[i];
+        limb c1 = s > a[i];
+        limb t = s - c;
+        c = c1 + (t > s);
+        r[i] = t;
+    }
+    return c;
+}
+
+#if CALC_X86
+
+__attribute__((target("avx512f")))
+limb add_nc_avx512(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m512i ones = _mm512_set1_epi64(-1);
+    const __m512i one = _mm512_set1_epi64(1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512i va = _mm512_loadu_si512((const void*)(a + i));
+        __m512i vb = _mm512_loadu_si512((const void*)(b + i));
+        __m512i s = _mm512_add_epi64(va, vb);
+        unsigned g = _mm512_cmplt_epu64_mask(s, va);
+        unsigned p = _mm512_cmpeq_epi64_mask(s, ones);
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 8;
+        s = _mm512_mask_add_epi64(s, (__mmask8)(t ^ p), s, one);
+        _mm512_storeu_si512((void*)(r + i), s);
+    }
+    return add_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+__attribute__((target("avx512f")))
+limb sub_nc_avx512(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m512i one = _mm512_set1_epi64(1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512i va = _mm512_loadu_si512((const void*)(a + i));
+        __m512i vb = _mm512_loadu_si512((const void*)(b + i));
+        __m512i d = _mm512_sub_epi64(va, vb);
+        unsigned g = _mm512_cmplt_epu64_mask(va, vb);
+        unsigned p = _mm512_cmpeq_epi64_mask(d, _mm512_setzero_si512());
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 8;
+        d = _mm512_mask_sub_epi64(d, (__mmask8)(t ^ p), d, one);
+        _mm512_storeu_si512((void*)(r + i), d);
+    }
+    return sub_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+// 4 位掩码到各通道 0/1 的查找表，SSE4.2 版本只用前 4 项的低两个通道
+alignas(32) const limb LANE_BITS[16][4] = {
+    {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0}, {1, 1, 0, 0},
+    {0, 0, 1, 0}, {1, 0, 1, 0}, {0, 1, 1, 0}, {1, 1, 1, 0},
+    {0, 0, 0, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {1, 1, 0, 1},
+    {0, 0, 1, 1}, {1, 0, 1, 1}, {0, 1, 1, 1}, {1, 1, 1, 1},
+};
+
+__attribute__((target("avx2")))
+limb add_nc_avx2(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i s = _mm256_add_epi64(va, vb);
+        // 无符号比较 s < va：两边同时翻转符号位后做有符号比较
+        __m256i gv = _mm256_cmpgt_epi64(_mm256_xor_si256(va, sign), _mm256_xor_si256(s, sign));
+        __m256i pv = _mm256_cmpeq_epi64(s, ones);
+        unsigned g = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(gv));
+        unsigned p = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(pv));
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 4;
+        s = _mm256_add_epi64(s, _mm256_load_si256((const __m256i*)LANE_BITS[(t ^ p) & 15]));
+        _mm256_storeu_si256((__m256i*)(r + i), s);
+    }
+    return add_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+limb sub_nc_avx2(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i d = _mm256_sub_epi64(va, vb);
+        __m256i gv = _mm256_cmpgt_epi64(_mm256_xor_si256(vb, sign), _mm256_xor_si256(va, sign));
+        __m256i pv = _mm256_cmpeq_epi64(d, _mm256_setzero_si256());
+        unsigned g = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(gv));
+        unsigned p = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(pv));
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 4;
+        d = _mm256_sub_epi64(d, _mm256_load_si256((const __m256i*)LANE_BITS[(t ^ p) & 15]));
+        _mm256_storeu_si256((__m256i*)(r + i), d);
+    }
+    return sub_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+// SSE4.2 提供了 64 位比较指令 pcmpgtq，两通道一组
+__attribute__((target("sse4.2")))
+limb add_nc_sse42(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m128i ones = _mm_set1_epi64x(-1);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i s = _mm_add_epi64(va, vb);
+        __m128i gv = _mm_cmpgt_epi64(_mm_xor_si128(va, sign), _mm_xor_si128(s, sign));
+        __m128i pv = _mm_cmpeq_epi64(s, ones);
+        unsigned g = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(gv));
+        unsigned p = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(pv));
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 2;
+        s = _mm_add_epi64(s, _mm_load_si128((const __m128i*)LANE_BITS[(t ^ p) & 3]));
+        _mm_storeu_si128((__m128i*)(r + i), s);
+    }
+    return add_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+__attribute__((target("sse4.2")))
+limb sub_nc_sse42(limb* r, const limb* a, const limb* b, size_t n, limb c)
+{
+    const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i d = _mm_sub_epi64(va, vb);
+        __m128i gv = _mm_cmpgt_epi64(_mm_xor_si128(vb, sign), _mm_xor_si128(va, sign));
+        __m128i pv = _mm_cmpeq_epi64(d, _mm_setzero_si128());
+        unsigned g = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(gv));
+        unsigned p = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(pv));
+        unsigned t = (g << 1) + p + (unsigned)c;
+        c = t >> 2;
+        d = _mm_sub_epi64(d, _mm_load_si128((const __m128i*)LANE_BITS[(t ^ p) & 3]));
+        _mm_storeu_si128((__m128i*)(r + i), d);
+    }
+    return sub_nc_scalar(r + i, a + i, b + i, n - i, c);
+}
+
+#endif
+
+// ---------- 单肢乘法内核 ----------
+
+// r = a * b，返回最高位进位
+limb mul_1_scalar(limb* r, const limb* a, size_t n, limb b)
+{
+    limb c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        dlimb t = (dlimb)a[i] * b + c;
+        r[i] = (limb)t;
+        c = (limb)(t >> LIMB_BITS);
+    }
+    return c;
+}
+
+// r += a * b，返回最高位进位
+limb addmul_1_scalar(limb* r, const limb* a, size_t n, limb b)
+{
+    limb c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        dlimb t = (dlimb)a[i] * b + r[i] + c;
+        r[i] = (limb)t;
+        c = (limb)(t >> LIMB_BITS);
+    }
+    return c;
+}
+
+// r -= a * b，返回最高位借位
+limb submul_1_scalar(limb* r, const limb* a, size_t n, limb b)
+{
+    limb c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        dlimb t = (dlimb)a[i] * b + c;
+        limb lo = (limb)t;
+        c = (limb)(t >> LIMB_BITS) + (r[i] < lo);
+        r[i] -= lo;
+    }
+    return c;
+}
+
+#if CALC_X86
+
+// BMI2 的 mulx 不影响标志位，ADX 的 adcx/adox 各自使用一条独立的进位链，
+// 于是“低半部分 + 上一个高半部分”和“累加到 r”两条进位链可以交错执行。
+
+__attribute__((target("bmi2,adx")))
+limb mul_1_adx(limb* r, const limb* a, size_t n, limb b)
+{
+    unsigned char c = 0;
+    unsigned long long hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned long long h;
+        unsigned long long lo = _mulx_u64(a[i], b, &h);
+        unsigned long long t;
+        c = _addcarryx_u64(c, lo, hi, &t);
+        r[i] = t;
+        hi = h;
+    }
+    return hi + c;
+}
+
+__attribute__((target("bmi2,adx")))
+limb addmul_1_adx(limb* r, const limb* a, size_t n, limb b)
+{
+    unsigned char c1 = 0, c2 = 0;
+    unsigned long long hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned long long h;
+        unsigned long long lo = _mulx_u64(a[i], b, &h);
+        unsigned long long t, s;
+        c1 = _addcarryx_u64(c1, lo, hi, &t);
+        c2 = _addcarryx_u64(c2, r[i], t, &s);
+        r[i] = s;
+        hi = h;
+    }
+    return hi + c1 + c2;
+}
+
+__attribute__((target("bmi2,adx")))
+limb submul_1_adx(limb* r, const limb* a, size_t n, limb b)
+{
+    unsigned char c1 = 0, c2 = 0;
+    unsigned long long hi = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned long long h;
+        unsigned long long lo = _mulx_u64(a[i], b, &h);
+        unsigned long long t, s;
+        c1 = _addcarryx_u64(c1, lo, hi, &t);
+        c2 = _subborrow_u64(c2, r[i], t, &s);
+        r[i] = s;
+        hi = h;
+    }
+    return hi + c1 + c2;
+}
+
+#endif
+
+// ---------- NTT 蝶形内核 ----------
+// 模数小于 2^30，系数用 32 位无符号数存放。乘法用 Montgomery 约简(R = 2^32)：
+// mont_mul(a, b) = a*b/R mod p。单位根预先乘上 R 存成 Montgomery 形式，与普通形式的系数相乘后结果仍是普通形式。
+// 一次蝶形调用处理 n 对系数 x[i]、y[i]，第 i 对的单位根为 w[i*ws]，ws 为 0 表示所有对共用一个单位根。
+// 约简的两半都取乘积的高 32 位：t = hi(a*b) - hi(q*p)，其中 q = lo(a*b) * p^-1 mod 2^32，t 落在 (-p, p)。
+
+struct NttMod
+{
+    std::uint32_t p;
+    std::uint32_t pinv;  // p^-1 mod 2^32
+    std::uint32_t r1;    // R mod p，即 1 的 Montgomery 形式
+    std::uint32_t r2;    // R^2 mod p，用于把普通形式转成 Montgomery 形式
+};
+
+inline std::uint32_t mont_mul(std::uint32_t a, std::uint32_t b, const NttMod& m)
+{
+    std::uint64_t t = (std::uint64_t)a * b;
+    std::uint32_t q = (std::uint32_t)t * m.pinv;
+    std::uint32_t r = (std::uint32_t)(t >> 32) - (std::uint32_t)(((std::uint64_t)q * m.p) >> 32);
+    return (std::int32_t)r < 0 ? r + m.p : r;
+}
+
+NttMod make_ntt_mod(std::uint32_t p)
+{
+    NttMod m;
+    m.p = p;
+    // p 为奇数时 p*p ≡ 1 (mod 8)，牛顿迭代每次把正确的位数翻倍，4 次即达到 32 位
+    std::uint32_t x = p;
+    for (int i = 0; i < 4; i++) x *= 2 - p * x;
+    m.pinv = x;
+    m.r1 = (std::uint32_t)(((std::uint64_t)1 << 32) % p);
+    m.r2 = (std::uint32_t)((std::uint64_t)m.r1 * m.r1 % p);
+    return m;
+}
+
+inline std::uint32_t add_mod(std::uint32_t a, std::uint32_t b, std::uint32_t p)
+{
+    std::uint32_t s = a + b;
+    return s >= p ? s - p : s;
+}
+
+inline std::uint32_t sub_mod(std::uint32_t a, std::uint32_t b, std::uint32_t p)
+{
+    return a >= b ? a - b : a + p - b;
+}
+
+// 频域抽取(DIF)：x' = x + y，y' = (x - y) * w
+void ntt_dif_scalar(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        std::uint32_t u = x[i], v = y[i];
+        x[i] = add_mod(u, v, m.p);
+        y[i] = mont_mul(sub_mod(u, v, m.p), w[i * ws], m);
+    }
+}
+
+// 时域抽取(DIT)：t = y * w，x' = x + t，y' = x - t
+void ntt_dit_scalar(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        std::uint32_t u = x[i], t = mont_mul(y[i], w[i * ws], m);
+        x[i] = add_mod(u, t, m.p);
+        y[i] = sub_mod(u, t, m.p);
+    }
+}
+
+// 逐点乘：r[i] = a[i] * b[i*bs] / R
+void ntt_mul_scalar(std::uint32_t* r, const std::uint32_t* a, const std::uint32_t* b, size_t bs, size_t n, const NttMod& m)
+{
+    for (size_t i = 0; i < n; i++) r[i] = mont_mul(a[i], b[i * bs], m);
+}
+
+// 连续 len 个系数上半长为 4、2、1 的最后三级 DIF 蝶形(roots 为按级排列的单位根表)。
+// 这几级每对系数挨得太近，凑不满一个向量，单独成为一个内核。
+const size_t NTT_TAIL_HALF = 8;
+
+void ntt_dif_tail_scalar(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    for (size_t h = std::min(len, NTT_TAIL_HALF) / 2; h >= 1; h >>= 1)
+    {
+        for (size_t i = 0; i < len; i += 2 * h)
+        {
+            for (size_t k = 0; k < h; k++)
+            {
+                std::uint32_t u = a[i + k], v = a[i + k + h];
+                a[i + k] = add_mod(u, v, m.p);
+                a[i + k + h] = mont_mul(sub_mod(u, v, m.p), roots[h + k], m);
+            }
+        }
+    }
+}
+
+// DIT 的最前三级，与 ntt_dif_tail 互逆
+void ntt_dit_head_scalar(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    for (size_t h = 1; h < len && h < NTT_TAIL_HALF; h <<= 1)
+    {
+        for (size_t i = 0; i < len; i += 2 * h)
+        {
+            for (size_t k = 0; k < h; k++)
+            {
+                std::uint32_t u = a[i + k], t = mont_mul(a[i + k + h], roots[h + k], m);
+                a[i + k] = add_mod(u, t, m.p);
+                a[i + k + h] = sub_mod(u, t, m.p);
+            }
+        }
+    }
+}
+
+#if CALC_X86
+
+// 8 个通道各自做 Montgomery 乘法：偶数通道和奇数通道分两次 32x32->64 乘，再把高半拼回来
+__attribute__((target("avx2")))
+inline __m256i mont_mul_avx2(__m256i a, __m256i b, __m256i p, __m256i pinv)
+{
+    __m256i ae = _mm256_mul_epu32(a, b);
+    __m256i ao = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    __m256i qe = _mm256_mul_epu32(_mm256_mul_epu32(ae, pinv), p);
+    __m256i qo = _mm256_mul_epu32(_mm256_mul_epu32(ao, pinv), p);
+    __m256i hi = _mm256_blend_epi32(_mm256_srli_epi64(ae, 32), ao, 0xAA);
+    __m256i hq = _mm256_blend_epi32(_mm256_srli_epi64(qe, 32), qo, 0xAA);
+    __m256i t = _mm256_sub_epi32(hi, hq);
+    return _mm256_min_epu32(t, _mm256_add_epi32(t, p));
+}
+
+// 以下各内核只在步长为 0 且 n > 0 时读 w[0] / b[0] 做广播：AVX-512 内核把剩下的元素交给 AVX2 内核时，
+// 长度恰好是 16 的倍数的话 n 为 0，w + i*ws 已经指到数组末尾之后
+__attribute__((target("avx2")))
+void ntt_dif_avx2(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    const __m256i p = _mm256_set1_epi32((int)m.p);
+    const __m256i pinv = _mm256_set1_epi32((int)m.pinv);
+    __m256i vw = ws == 0 && n ? _mm256_set1_epi32((int)w[0]) : _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(x + i));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(y + i));
+        if (ws) vw = _mm256_loadu_si256((const __m256i*)(w + i));
+        __m256i s = _mm256_add_epi32(u, v);
+        __m256i d = _mm256_sub_epi32(u, v);
+        s = _mm256_min_epu32(s, _mm256_sub_epi32(s, p));
+        d = _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+        _mm256_storeu_si256((__m256i*)(x + i), s);
+        _mm256_storeu_si256((__m256i*)(y + i), mont_mul_avx2(d, vw, p, pinv));
+    }
+    ntt_dif_scalar(x + i, y + i, w + i * ws, ws, n - i, m);
+}
+
+__attribute__((target("avx2")))
+void ntt_dit_avx2(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    const __m256i p = _mm256_set1_epi32((int)m.p);
+    const __m256i pinv = _mm256_set1_epi32((int)m.pinv);
+    __m256i vw = ws == 0 && n ? _mm256_set1_epi32((int)w[0]) : _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(x + i));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(y + i));
+        if (ws) vw = _mm256_loadu_si256((const __m256i*)(w + i));
+        __m256i t = mont_mul_avx2(v, vw, p, pinv);
+        __m256i s = _mm256_add_epi32(u, t);
+        __m256i d = _mm256_sub_epi32(u, t);
+        _mm256_storeu_si256((__m256i*)(x + i), _mm256_min_epu32(s, _mm256_sub_epi32(s, p)));
+        _mm256_storeu_si256((__m256i*)(y + i), _mm256_min_epu32(d, _mm256_add_epi32(d, p)));
+    }
+    ntt_dit_scalar(x + i, y + i, w + i * ws, ws, n - i, m);
+}
+
+// 一组蝶形：x、y 各是 8 个通道
+__attribute__((target("avx2")))
+inline void dif_avx2(__m256i& x, __m256i& y, __m256i w, __m256i p, __m256i pinv)
+{
+    __m256i s = _mm256_add_epi32(x, y);
+    __m256i d = _mm256_sub_epi32(x, y);
+    x = _mm256_min_epu32(s, _mm256_sub_epi32(s, p));
+    y = mont_mul_avx2(_mm256_min_epu32(d, _mm256_add_epi32(d, p)), w, p, pinv);
+}
+
+__attribute__((target("avx2")))
+inline void dit_avx2(__m256i& x, __m256i& y, __m256i w, __m256i p, __m256i pinv)
+{
+    __m256i t = mont_mul_avx2(y, w, p, pinv);
+    __m256i s = _mm256_add_epi32(x, t);
+    __m256i d = _mm256_sub_epi32(x, t);
+    x = _mm256_min_epu32(s, _mm256_sub_epi32(s, p));
+    y = _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+}
+
+// 8x8 的 32 位矩阵转置，v[i] 为第 i 行
+__attribute__((target("avx2")))
+inline void transpose8_avx2(__m256i* v)
+{
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(v[i], v[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(v[i], v[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4)
+    {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        v[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        v[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+// 每 8 个相邻系数自成一组，8 组一起转置成 8 个向量，组内的蝶形就变成向量之间的运算
+__attribute__((target("avx2")))
+void ntt_dif_tail_avx2(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    const __m256i p = _mm256_set1_epi32((int)m.p);
+    const __m256i pinv = _mm256_set1_epi32((int)m.pinv);
+    __m256i w[8];
+    for (int j = 1; j < 8; j++) w[j] = _mm256_set1_epi32((int)roots[j]);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i v[8];
+        for (int j = 0; j < 8; j++) v[j] = _mm256_loadu_si256((const __m256i*)(a + i + 8 * j));
+        transpose8_avx2(v);
+        for (int j = 0; j < 4; j++) dif_avx2(v[j], v[j + 4], w[4 + j], p, pinv);
+        for (int j = 0; j < 8; j += 4)
+        {
+            dif_avx2(v[j], v[j + 2], w[2], p, pinv);
+            dif_avx2(v[j + 1], v[j + 3], w[3], p, pinv);
+        }
+        for (int j = 0; j < 8; j += 2) dif_avx2(v[j], v[j + 1], w[1], p, pinv);
+        transpose8_avx2(v);
+        for (int j = 0; j < 8; j++) _mm256_storeu_si256((__m256i*)(a + i + 8 * j), v[j]);
+    }
+    ntt_dif_tail_scalar(a + i, len - i, roots, m);
+}
+
+__attribute__((target("avx2")))
+void ntt_dit_head_avx2(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    const __m256i p = _mm256_set1_epi32((int)m.p);
+    const __m256i pinv = _mm256_set1_epi32((int)m.pinv);
+    __m256i w[8];
+    for (int j = 1; j < 8; j++) w[j] = _mm256_set1_epi32((int)roots[j]);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i v[8];
+        for (int j = 0; j < 8; j++) v[j] = _mm256_loadu_si256((const __m256i*)(a + i + 8 * j));
+        transpose8_avx2(v);
+        for (int j = 0; j < 8; j += 2) dit_avx2(v[j], v[j + 1], w[1], p, pinv);
+        for (int j = 0; j < 8; j += 4)
+        {
+            dit_avx2(v[j], v[j + 2], w[2], p, pinv);
+            dit_avx2(v[j + 1], v[j + 3], w[3], p, pinv);
+        }
+        for (int j = 0; j < 4; j++) dit_avx2(v[j], v[j + 4], w[4 + j], p, pinv);
+        transpose8_avx2(v);
+        for (int j = 0; j < 8; j++) _mm256_storeu_si256((__m256i*)(a + i + 8 * j), v[j]);
+    }
+    ntt_dit_head_scalar(a + i, len - i, roots, m);
+}
+
+__attribute__((target("avx2")))
+void ntt_mul_avx2(std::uint32_t* r, const std::uint32_t* a, const std::uint32_t* b, size_t bs, size_t n, const NttMod& m)
+{
+    const __m256i p = _mm256_set1_epi32((int)m.p);
+    const __m256i pinv = _mm256_set1_epi32((int)m.pinv);
+    __m256i vb = bs == 0 && n ? _mm256_set1_epi32((int)b[0]) : _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        if (bs) vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        _mm256_storeu_si256((__m256i*)(r + i), mont_mul_avx2(va, vb, p, pinv));
+    }
+    ntt_mul_scalar(r + i, a + i, b + i * bs, bs, n - i, m);
+}
+
+// AVX-512 版本与 AVX2 相同，只是一次处理 16 个通道。
+// GCC 12 的 avx512fintrin.h 在这些内建函数上会误报 -Wmaybe-uninitialized，这里局部关掉。
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+inline __m512i mont_mul_avx512(__m512i a, __m512i b, __m512i p, __m512i pinv)
+{
+    __m512i ae = _mm512_mul_epu32(a, b);
+    __m512i ao = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    __m512i qe = _mm512_mul_epu32(_mm512_mul_epu32(ae, pinv), p);
+    __m512i qo = _mm512_mul_epu32(_mm512_mul_epu32(ao, pinv), p);
+    __m512i hi = _mm512_mask_blend_epi32((__mmask16)0xAAAA, _mm512_srli_epi64(ae, 32), ao);
+    __m512i hq = _mm512_mask_blend_epi32((__mmask16)0xAAAA, _mm512_srli_epi64(qe, 32), qo);
+    __m512i t = _mm512_sub_epi32(hi, hq);
+    return _mm512_min_epu32(t, _mm512_add_epi32(t, p));
+}
+
+__attribute__((target("avx512f")))
+void ntt_dif_avx512(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    const __m512i p = _mm512_set1_epi32((int)m.p);
+    const __m512i pinv = _mm512_set1_epi32((int)m.pinv);
+    __m512i vw = ws == 0 && n ? _mm512_set1_epi32((int)w[0]) : _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i u = _mm512_loadu_si512((const void*)(x + i));
+        __m512i v = _mm512_loadu_si512((const void*)(y + i));
+        if (ws) vw = _mm512_loadu_si512((const void*)(w + i));
+        __m512i s = _mm512_add_epi32(u, v);
+        __m512i d = _mm512_sub_epi32(u, v);
+        s = _mm512_min_epu32(s, _mm512_sub_epi32(s, p));
+        d = _mm512_min_epu32(d, _mm512_add_epi32(d, p));
+        _mm512_storeu_si512((void*)(x + i), s);
+        _mm512_storeu_si512((void*)(y + i), mont_mul_avx512(d, vw, p, pinv));
+    }
+    ntt_dif_avx2(x + i, y + i, w + i * ws, ws, n - i, m);
+}
+
+__attribute__((target("avx512f")))
+void ntt_dit_avx512(std::uint32_t* x, std::uint32_t* y, const std::uint32_t* w, size_t ws, size_t n, const NttMod& m)
+{
+    const __m512i p = _mm512_set1_epi32((int)m.p);
+    const __m512i pinv = _mm512_set1_epi32((int)m.pinv);
+    __m512i vw = ws == 0 && n ? _mm512_set1_epi32((int)w[0]) : _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i u = _mm512_loadu_si512((const void*)(x + i));
+        __m512i v = _mm512_loadu_si512((const void*)(y + i));
+        if (ws) vw = _mm512_loadu_si512((const void*)(w + i));
+        __m512i t = mont_mul_avx512(v, vw, p, pinv);
+        __m512i s = _mm512_add_epi32(u, t);
+        __m512i d = _mm512_sub_epi32(u, t);
+        _mm512_storeu_si512((void*)(x + i), _mm512_min_epu32(s, _mm512_sub_epi32(s, p)));
+        _mm512_storeu_si512((void*)(y + i), _mm512_min_epu32(d, _mm512_add_epi32(d, p)));
+    }
+    ntt_dit_avx2(x + i, y + i, w + i * ws, ws, n - i, m);
+}
+
+__attribute__((target("avx512f")))
+void ntt_mul_avx512(std::uint32_t* r, const std::uint32_t* a, const std::uint32_t* b, size_t bs, size_t n, const NttMod& m)
+{
+    const __m512i p = _mm512_set1_epi32((int)m.p);
+    const __m512i pinv = _mm512_set1_epi32((int)m.pinv);
+    __m512i vb = bs == 0 && n ? _mm512_set1_epi32((int)b[0]) : _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i va = _mm512_loadu_si512((const void*)(a + i));
+        if (bs) vb = _mm512_loadu_si512((const void*)(b + i));
+        _mm512_storeu_si512((void*)(r + i), mont_mul_avx512(va, vb, p, pinv));
+    }
+    ntt_mul_avx2(r + i, a + i, b + i * bs, bs, n - i, m);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+// ---------- 运行时内核分派 ----------
+// 启动时用 CPUID 检测一次，从低到高依次为 scalar、sse4.2、avx2、bmi2(avx2 加上 mulx/adx 乘法)、avx512。
+// 环境变量 CALC_KERNELS 可以把档位压低到指定值，便于对比测试；CPU 不支持的档位会自动降级。
+
+struct Kernels
+{
+    const char* name;
+    limb (*add_nc)(limb*, const limb*, const limb*, size_t, limb);
+    limb (*sub_nc)(limb*, const limb*, const limb*, size_t, limb);
+    limb (*mul_1)(limb*, const limb*, size_t, limb);
+    limb (*addmul_1)(limb*, const limb*, size_t, limb);
+    limb (*submul_1)(limb*, const limb*, size_t, limb);
+    void (*ntt_dif)(std::uint32_t*, std::uint32_t*, const std::uint32_t*, size_t, size_t, const NttMod&);
+    void (*ntt_dit)(std::uint32_t*, std::uint32_t*, const std::uint32_t*, size_t, size_t, const NttMod&);
+    void (*ntt_mul)(std::uint32_t*, const std::uint32_t*, const std::uint32_t*, size_t, size_t, const NttMod&);
+    void (*ntt_dif_tail)(std::uint32_t*, size_t, const std::uint32_t*, const NttMod&);
+    void (*ntt_dit_head)(std::uint32_t*, size_t, const std::uint32_t*, const NttMod&);
+};
+
+const char* const KERNEL_TIERS[] = {"scalar", "sse4.2", "avx2", "bmi2", "avx512"};
+const int KERNEL_TIER_COUNT = 5;
+
+// 当前 CPU 支持的最高档位
+int detect_kernel_tier()
+{
+#if CALC_X86
+    __builtin_cpu_init();
+    unsigned eax, ebx = 0, ecx, edx;
+    bool adx = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 19));
+    bool mulx = __builtin_cpu_supports("bmi2") && adx;
+    if (__builtin_cpu_supports("avx512f") && mulx) return 4;
+    if (__builtin_cpu_supports("avx2") && mulx) return 3;
+    if (__builtin_cpu_supports("avx2")) return 2;
+    if (__builtin_cpu_supports("sse4.2")) return 1;
+#endif
+    return 0;
+}
+
+Kernels make_kernels(int tier)
+{
+    Kernels k = {KERNEL_TIERS[tier], add_nc_scalar, sub_nc_scalar, mul_1_scalar, addmul_1_scalar, submul_1_scalar,
+                 ntt_dif_scalar, ntt_dit_scalar, ntt_mul_scalar, ntt_dif_tail_scalar, ntt_dit_head_scalar};
+#if CALC_X86
+    if (tier >= 1)
+    {
+        k.add_nc = add_nc_sse42;
+        k.sub_nc = sub_nc_sse42;
+    }
+    if (tier >= 2)
+    {
+        k.add_nc = add_nc_avx2;
+        k.sub_nc = sub_nc_avx2;
+        k.ntt_dif = ntt_dif_avx2;
+        k.ntt_dit = ntt_dit_avx2;
+        k.ntt_mul = ntt_mul_avx2;
+        k.ntt_dif_tail = ntt_dif_tail_avx2;
+        k.ntt_dit_head = ntt_dit_head_avx2;
+    }
+    if (tier >= 3)
+    {
+        k.mul_1 = mul_1_adx;
+        k.addmul_1 = addmul_1_adx;
+        k.submul_1 = submul_1_adx;
+    }
+    if (tier >= 4)
+    {
+        k.add_nc = add_nc_avx512;
+        k.sub_nc = sub_nc_avx512;
+        k.ntt_dif = ntt_dif_avx512;
+        k.ntt_dit = ntt_dit_avx512;
+        k.ntt_mul = ntt_mul_avx512;
+    }
+#endif
+    return k;
+}
+
+Kernels select_kernels()
+{
+    int tier = detect_kernel_tier();
+    const char* env = std::getenv("CALC_KERNELS");
+    if (env)
+    {
+        int want = -1;
+        for (int i = 0; i < KERNEL_TIER_COUNT; i++)
+        {
+            if (std::string(env) == KERNEL_TIERS[i]) want = i;
+        }
+        if (want < 0) std::cerr << "警告: 未知的 CALC_KERNELS 值 " << env << "，已忽略\n";
+        else if (want > tier) std::cerr << "警告: CPU 不支持 " << env << "，使用 " << KERNEL_TIERS[tier] << "\n";
+        else tier = want;
+    }
+    return make_kernels(tier);
+}
+
+// 全局初始化时选定，之后只读
+const Kernels g_kernels = select_kernels();
+
+limb add_n(limb* r, const limb* a, const limb* b, size_t n)
+{
+    return g_kernels.add_nc(r, a, b, n, 0);
+}
+
+limb sub_n(limb* r, const limb* a, const limb* b, size_t n)
+{
+    return g_kernels.sub_nc(r, a, b, n, 0);
+}
+
+limb mul_1(limb* r, const limb* a, size_t n, limb b)
+{
+    return g_kernels.mul_1(r, a, n, b);
+}
+
+limb addmul_1(limb* r, const limb* a, size_t n, limb b)
+{
+    return g_kernels.addmul_1(r, a, n, b);
+}
+
+limb submul_1(limb* r, const limb* a, size_t n, limb b)
+{
+    return g_kernels.submul_1(r, a, n, b);
+}
+
+// an >= bn；进位消失后剩下的肢直接复制
+limb add(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    limb c = add_n(r, a, b, bn);
+    size_t i = bn;
+    for (; c && i < an; i++)
+    {
+        r[i] = a[i] + 1;
+        c = r[i] == 0;
+    }
+    if (r != a) std::copy(a + i, a + an, r + i);
+    return c;
+}
+
+// an >= bn；借位消失后剩下的肢直接复制
+limb sub(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    limb c = sub_n(r, a, b, bn);
+    size_t i = bn;
+    for (; c && i < an; i++)
+    {
+        limb v = a[i];
+        r[i] = v - 1;
+        c = v == 0;
+    }
+    if (r != a) std::copy(a + i, a + an, r + i);
+    return c;
+}
+
+// r = a << cnt，0 < cnt < 64，返回移出的高位
+limb lshift(limb* r, const limb* a, size_t n, int cnt)
+{
+    limb out = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        limb v = a[i];
+        r[i] = (v << cnt) | out;
+        out = v >> (LIMB_BITS - cnt);
+    }
+    return out;
+}
+
+// r = a >> cnt，0 < cnt < 64
+void rshift(limb* r, const limb* a, size_t n, int cnt)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        limb hi = i + 1 < n ? a[i + 1] << (LIMB_BITS - cnt) : 0;
+        r[i] = (a[i] >> cnt) | hi;
+    }
+}
+
+int clz_limb(limb x)
+{
+    return __builtin_clzll(x);
+}
+
+// 单肢除数及其预计算的倒数(Möller-Granlund 算法)。
+// 同一个除数反复使用时只需构造一次，之后每个肢的除法只要两次乘法和少量加减。
+struct Divisor1
+{
+    limb d;     // 规格化后的除数，最高位为 1
+    limb v;     // floor((B^2 - 1) / d) - B
+    int sh;     // 规格化时左移的位数
+
+    explicit Divisor1(limb x)
+    {
+        sh = clz_limb(x);
+        d = x << sh;
+        v = (limb)((((dlimb)~d) << LIMB_BITS | ~(limb)0) / d);
+    }
+};
+
+// (u1, u0) / d，要求 u1 < d，余数写入 r
+inline limb div_2by1(limb& r, limb u1, limb u0, const Divisor1& dv)
+{
+    dlimb t = (dlimb)dv.v * u1 + ((((dlimb)u1) << LIMB_BITS) | u0);
+    limb q1 = (limb)(t >> LIMB_BITS) + 1;
+    limb q0 = (limb)t;
+    limb rr = u0 - q1 * dv.d;
+    // 第一次修正经常发生，用掩码代替分支；第二次修正极少发生
+    limb mask = (limb)0 - (limb)(rr > q0);
+    q1 += mask;
+    rr += mask & dv.d;
+    if (rr >= dv.d)
+    {
+        q1++;
+        rr -= dv.d;
+    }
+    r = rr;
+    return q1;
+}
+
+// q = a / d，返回余数；规格化的移位在循环中顺带完成，只扫描一遍
+limb divrem_1(limb* q, const limb* a, size_t n, const Divisor1& dv)
+{
+    if (n == 0) return 0;
+    limb r = 0;
+    if (dv.sh == 0)
+    {
+        while (n-- > 0) q[n] = div_2by1(r, r, a[n], dv);
+        return r;
+    }
+
+    r = a[n - 1] >> (LIMB_BITS - dv.sh);
+    for (size_t i = n; i-- > 0; )
+    {
+        limb u0 = a[i] << dv.sh;
+        if (i > 0) u0 |= a[i - 1] >> (LIMB_BITS - dv.sh);
+        q[i] = div_2by1(r, r, u0, dv);
+    }
+    return r >> dv.sh;
+}
+
+limb divrem_1(limb* q, const limb* a, size_t n, limb d)
+{
+    return divrem_1(q, a, n, Divisor1(d));
+}
+
+// r[0 .. an+bn) = a * b，要求 an >= bn >= 1，r 不能与 a、b 重叠
+void mul_basecase(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    r[an] = mul_1(r, a, an, b[0]);
+    for (size_t j = 1; j < bn; j++)
+    {
+        r[an + j] = addmul_1(r + j, a, an, b[j]);
+    }
+}
+
+// r[0 .. 2n) = a^2，n >= 1，r 不能与 a 重叠。
+// 交叉项 a[i]*a[j] (i < j) 只算一次再整体左移一位，最后补上对角线上的平方项。
+void sqr_basecase(limb* r, const limb* a, size_t n)
+{
+    std::fill(r, r + 2 * n, (limb)0);
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+        r[i + n] = addmul_1(r + 2 * i + 1, a + i + 1, n - 1 - i, a[i]);
+    }
+
+    limb top = 0;
+    for (size_t i = 0; i < 2 * n; i++)
+    {
+        limb v = r[i];
+        r[i] = (v << 1) | top;
+        top = v >> (LIMB_BITS - 1);
+    }
+
+    limb c = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        dlimb sq = (dlimb)a[i] * a[i];
+        dlimb lo = (dlimb)r[2 * i] + (limb)sq + c;
+        r[2 * i] = (limb)lo;
+        dlimb hi = (dlimb)r[2 * i + 1] + (limb)(sq >> LIMB_BITS) + (limb)(lo >> LIMB_BITS);
+        r[2 * i + 1] = (limb)hi;
+        c = (limb)(hi >> LIMB_BITS);
+    }
+}
+
+// ---------- 任务并行 ----------
+// 工作窃取(work-stealing)线程池，乘法各层把互相独立的子乘积分叉出去，由多个核一起算。
+// 每个线程有自己的双端队列：自己从尾部压入、弹出(后进先出，数据还在缓存里)，
+// 空闲时从别人的队列头部偷(先进先出，偷到的往往是较大的子问题)。池外的线程共用 0 号队列。
+// 等待一组任务时不会干等，而是继续执行能拿到的任何任务，所以任意深度的嵌套分叉都不会死锁。
+// 线程数默认取 CPU 核数，子问题较短操作数不到 cutoff 个肢时不分叉；
+// 环境变量 CALC_THREADS、CALC_PAR_CUTOFF 可以覆盖这两个值，线程数为 1 时一切都串行执行。
+
+struct ParallelConfig
+{
+    unsigned threads;
+    size_t cutoff;
+};
+
+ParallelConfig read_parallel_config()
+{
+    ParallelConfig c;
+    c.threads = std::thread::hardware_concurrency();
+    c.cutoff = 2000;
+    if (const char* env = std::getenv("CALC_THREADS")) c.threads = (unsigned)std::strtoul(env, NULL, 10);
+    if (const char* env = std::getenv("CALC_PAR_CUTOFF")) c.cutoff = std::strtoul(env, NULL, 10);
+    if (c.threads == 0) c.threads = 1;
+    return c;
+}
+
+// 全局初始化时确定；多线程批处理在启动工作线程之前把线程数改成 1，之后只读
+ParallelConfig g_par = read_parallel_config();
+
+// 较短操作数为 n 个肢的乘法是否值得拆给多个线程
+bool par_worth(size_t n)
+{
+    return g_par.threads > 1 && n >= g_par.cutoff;
+}
+
+class TaskGroup;
+
+struct Task
+{
+    std::function<void()> fn;
+    TaskGroup* group;
+};
+
+// 当前线程的队列号：池内工作线程为 1 .. threads-1，其余线程为 0
+thread_local size_t t_queue = 0;
+
+class TaskPool
+{
+public:
+    static TaskPool& instance()
+    {
+        static TaskPool pool(g_par.threads);
+        return pool;
+    }
+
+    ~TaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mu);
+            stop = true;
+        }
+        sleep_cv.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    void push(Task t)
+    {
+        Queue& q = *queues[t_queue];
+        {
+            std::lock_guard<std::mutex> lock(q.mu);
+            q.tasks.push_back(std::move(t));
+        }
+        queued++;
+        // 先碰一下 sleep_mu，保证正在入睡的线程要么看到 queued > 0，要么收到通知
+        {
+            std::lock_guard<std::mutex> lock(sleep_mu);
+        }
+        sleep_cv.notify_one();
+    }
+
+    // 取一个任务执行：先看自己的队列尾部，再依次偷别人的队列头部；没有任务时返回 false
+    bool run_one();
+
+    // 等待 g 的任务全部完成。期间有任务就帮着执行，没有就睡在 sleep_cv 上，
+    // 直到有新任务入队或者 g 的最后一个任务完成，不会空转占满一个核
+    void wait(TaskGroup& g);
+
+private:
+    struct Queue
+    {
+        std::mutex mu;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued;
+    std::mutex sleep_mu;
+    std::condition_variable sleep_cv;
+    bool stop;
+
+    explicit TaskPool(unsigned threads) : queued(0), stop(false)
+    {
+        for (unsigned i = 0; i < threads; i++) queues.push_back(std::unique_ptr<Queue>(new Queue));
+        for (unsigned i = 1; i < threads; i++) workers.push_back(std::thread(&TaskPool::work, this, (size_t)i));
+    }
+
+    // g 的最后一个任务完成时叫醒等待它的线程
+    void group_done()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mu);
+        }
+        sleep_cv.notify_all();
+    }
+
+    bool take(Task& t)
+    {
+        size_t n = queues.size(), self = t_queue;
+        {
+            Queue& q = *queues[self];
+            std::lock_guard<std::mutex> lock(q.mu);
+            if (!q.tasks.empty())
+            {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < n; k++)
+        {
+            Queue& q = *queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(q.mu);
+            if (!q.tasks.empty())
+            {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t id)
+    {
+        t_queue = id;
+        while (true)
+        {
+            if (run_one()) continue;
+            std::unique_lock<std::mutex> lock(sleep_mu);
+            sleep_cv.wait(lock, [this] { return stop || queued > 0; });
+            if (stop) return;
+        }
+    }
+};
+
+// 一组分叉出去的任务。构造时 parallel 为 false(子问题太小或只有一个线程)则 run 直接就地执行。
+// wait 返回后组内任务全部完成；析构时也会等待，任务里引用的局部变量因此总是有效的。
+class TaskGroup
+{
+public:
+    explicit TaskGroup(bool par) : parallel(par), pending(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(const std::function<void()>& fn)
+    {
+        if (!parallel)
+        {
+            fn();
+            return;
+        }
+        pending++;
+        Task t;
+        t.fn = fn;
+        t.group = this;
+        TaskPool::instance().push(std::move(t));
+    }
+
+    void wait()
+    {
+        if (pending.load(std::memory_order_acquire) > 0) TaskPool::instance().wait(*this);
+    }
+
+private:
+    bool parallel;
+    std::atomic<size_t> pending;
+    friend class TaskPool;
+};
+
+bool TaskPool::run_one()
+{
+    Task t;
+    if (!take(t)) return false;
+    queued--;
+    t.fn();
+    if (t.group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) group_done();
+    return true;
+}
+
+void TaskPool::wait(TaskGroup& g)
+{
+    while (g.pending.load(std::memory_order_acquire) > 0)
+    {
+        if (run_one()) continue;
+        std::unique_lock<std::mutex> lock(sleep_mu);
+        sleep_cv.wait(lock, [&] { return queued > 0 || g.pending.load(std::memory_order_acquire) == 0; });
+    }
+}
+
+// 把下标 [0, n) 均分成若干段交给 f(begin, end)；par 为 false 时整段就地执行
+void par_for(size_t n, bool par, const std::function<void(size_t, size_t)>& f)
+{
+    size_t parts = par ? std::min(n, (size_t)g_par.threads * 4) : 1;
+    TaskGroup g(parts > 1);
+    for (size_t i = 0; i < parts; i++)
+    {
+        size_t b = n * i / parts, e = n * (i + 1) / parts;
+        g.run([=, &f] { f(b, e); });
+    }
+    g.wait();
+}
+
+// ---------- 乘法分派 ----------
+// 较短操作数的肢数达到对应阈值时依次升级到 Karatsuba、Toom-3、Toom-4、NTT
+const size_t KARATSUBA_THRESHOLD = 32;
+const size_t SQR_KARATSUBA_THRESHOLD = 48;
+const size_t TOOM3_THRESHOLD = 600;
+const size_t TOOM4_THRESHOLD = 800;
+const size_t NTT_THRESHOLD = 2000;
+
+void mul(limb* r, const limb* a, size_t an, const limb* b, size_t bn);
+void sqr(limb* r, const limb* a, size_t n);
+
+// r[0 .. xn) = |x - y|，要求 xn >= yn；x < y 时返回 true
+bool abs_diff(limb* r, const limb* x, size_t xn, const limb* y, size_t yn)
+{
+    size_t top = xn;
+    while (top > yn && x[top - 1] == 0) top--;
+    if (top == yn && cmp_n(x, y, yn) < 0)
+    {
+        sub_n(r, y, x, yn);
+        std::fill(r + yn, r + xn, (limb)0);
+        return true;
+    }
+    sub(r, x, xn, y, yn);
+    return false;
+}
+
+// Karatsuba 乘法，要求 an >= bn > ceil(an / 2)
+// a = a1*B^h + a0, b = b1*B^h + b0
+// a*b = z2*B^2h + (z0 + z2 - (a0-a1)(b0-b1))*B^h + z0
+void mul_karatsuba(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    size_t h = (an + 1) / 2;
+    size_t rn = an + bn;
+
+    std::vector<limb> t(4 * h + 1);
+    limb* da = t.data();
+    limb* db = da + h;
+    limb* z1 = db + h;
+    bool sa = abs_diff(da, a, h, a + h, an - h);
+    bool sb = abs_diff(db, b, h, b + h, bn - h);
+
+    // 三个子乘积互不依赖
+    TaskGroup g(par_worth(bn));
+    g.run([=] { mul(r, a, h, b, h); });
+    g.run([=] { mul(r + 2 * h, a + h, an - h, b + h, bn - h); });
+    g.run([=] { mul(z1, da, h, db, h); });
+    g.wait();
+
+    // 中间项 = z0 + z2 -/+ z1，一定非负且不超过 2h+1 个肢
+    std::vector<limb> mid(2 * h + 1);
+    mid[2 * h] = add(mid.data(), r, 2 * h, r + 2 * h, rn - 2 * h);
+    if (sa == sb) sub(mid.data(), mid.data(), 2 * h + 1, z1, 2 * h);
+    else add(mid.data(), mid.data(), 2 * h + 1, z1, 2 * h);
+
+    size_t mn = std::min(2 * h + 1, rn - h);
+    add(r + h, r + h, rn - h, mid.data(), mn);
+}
+
+// ---------- 带符号辅助运算(供 Toom-Cook 求值和插值使用) ----------
+
+BigInt make_big(const limb* a, size_t n)
+{
+    BigInt r;
+    r.d.assign(a, a + n);
+    trim(r);
+    return r;
+}
+
+// r += x，或 negx 为真时 r -= x
+void sadd(BigInt& r, const BigInt& x, bool negx)
+{
+    if (x.isZero()) return;
+    bool xneg = x.neg != negx;
+    if (r.isZero() || r.neg == xneg)
+    {
+        r.neg = xneg;
+        if (r.size() < x.size()) r.d.resize(x.size(), 0);
+        limb c = add(r.d.data(), r.d.data(), r.size(), x.d.data(), x.size());
+        if (c) r.d.push_back(c);
+        return;
+    }
+
+    int c = r.size() != x.size() ? (r.size() > x.size() ? 1 : -1)
+                                 : cmp_n(r.d.data(), x.d.data(), r.size());
+    if (c > 0)
+    {
+        sub(r.d.data(), r.d.data(), r.size(), x.d.data(), x.size());
+    }
+    else
+    {
+        // x - r 直接写回 r：逐肢同下标读写，原地运算是安全的
+        size_t rn = r.size();
+        r.d.resize(x.size());
+        sub(r.d.data(), x.d.data(), x.size(), r.d.data(), rn);
+        r.neg = xneg;
+    }
+    trim(r);
+}
+
+void mul_small(BigInt& r, long long v)
+{
+    if (v == 0) r.d.clear();
+    limb c = mul_1(r.d.data(), r.d.data(), r.size(), (limb)(v < 0 ? -v : v));
+    if (c) r.d.push_back(c);
+    if (v < 0) r.neg = !r.neg;
+    trim(r);
+}
+
+// 已知能整除时的小整数除法
+void divexact_small(BigInt& r, long long v)
+{
+    divrem_1(r.d.data(), r.d.data(), r.size(), (limb)(v < 0 ? -v : v));
+    if (v < 0) r.neg = !r.neg;
+    trim(r);
+}
+
+// x 和 y 是同一个对象时按平方计算
+BigInt smul(const BigInt& x, const BigInt& y)
+{
+    BigInt r;
+    if (x.isZero() || y.isZero()) return r;
+    r.d.resize(x.size() + y.size());
+    if (&x == &y) sqr(r.d.data(), x.d.data(), x.size());
+    else mul(r.d.data(), x.d.data(), x.size(), y.d.data(), y.size());
+    r.neg = x.neg != y.neg;
+    trim(r);
+    return r;
+}
+
+// 秦九韶算法求 p(x)
+BigInt toom_eval(const std::vector<BigInt>& p, long long x)
+{
+    BigInt v = p.back();
+    for (size_t j = p.size() - 1; j-- > 0; )
+    {
+        mul_small(v, x);
+        sadd(v, p[j], false);
+    }
+    return v;
+}
+
+// 通用 Toom-Cook 乘法：a 切成 k1 段、b 切成 k2 段，每段 m 个肢。
+// 在 0, 1, -1, 2, -2, ... 这些有限点和无穷远点求值后逐点相乘(递归回到 mul)，
+// 先扣掉无穷远点给出的最高次系数，再用牛顿差商插值还原其余系数。
+// k1 == k2 时即 Toom-3 / Toom-4，k1 != k2 时即 Toom-32 / Toom-42 等不平衡版本。
+// a 与 b 是同一段内存时按平方处理，每个点只求值一次。
+void mul_toom(limb* r, const limb* a, size_t an, const limb* b, size_t bn, int k1, int k2)
+{
+    bool square = a == b && an == bn;
+    size_t m = std::max((an + k1 - 1) / k1, (bn + k2 - 1) / k2);
+    std::vector<BigInt> pa(k1), pb(k2);
+    for (int i = 0; i < k1; i++)
+    {
+        size_t lo = std::min(an, i * m), hi = std::min(an, (i + 1) * m);
+        pa[i] = make_big(a + lo, hi - lo);
+    }
+    for (int i = 0; i < k2; i++)
+    {
+        size_t lo = std::min(bn, i * m), hi = std::min(bn, (i + 1) * m);
+        pb[i] = make_big(b + lo, hi - lo);
+    }
+
+    int n = k1 + k2 - 2;   // 有限求值点个数，也是乘积多项式的次数
+    std::vector<long long> x(n);
+    for (int i = 0; i < n; i++) x[i] = i == 0 ? 0 : (i % 2 ? (i + 1) / 2 : -(i / 2));
+
+    // 各点的求值和逐点乘法互不依赖
+    BigInt top;
+    std::vector<BigInt> w(n);
+    TaskGroup g(par_worth(std::min(an, bn)));
+    g.run([&] { top = square ? smul(pa.back(), pa.back()) : smul(pa.back(), pb.back()); });
+    for (int i = 0; i < n; i++)
+    {
+        g.run([&, i] {
+            BigInt ea = toom_eval(pa, x[i]);
+            w[i] = square ? smul(ea, ea) : smul(ea, toom_eval(pb, x[i]));
+        });
+    }
+    g.wait();
+
+    for (int i = 0; i < n; i++)
+    {
+        long long xp = 1;
+        for (int j = 0; j < n; j++) xp *= x[i];
+        BigInt t = top;
+        mul_small(t, xp);
+        sadd(w[i], t, true);
+    }
+
+    // 牛顿差商
+    for (int j = 1; j < n; j++)
+    {
+        for (int i = n - 1; i >= j; i--)
+        {
+            sadd(w[i], w[i - 1], true);
+            divexact_small(w[i], x[i] - x[i - j]);
+        }
+    }
+
+    // 牛顿形式展开为普通系数：c = (...(w[n-1](x - x[n-2]) + w[n-2])...)(x - x[0]) + w[0]
+    std::vector<BigInt> c(n);
+    c[0] = w[n - 1];
+    for (int i = n - 2; i >= 0; i--)
+    {
+        for (int k = n - 1 - i; k > 0; k--)
+        {
+            BigInt t = c[k];
+            mul_small(t, -x[i]);
+            sadd(t, c[k - 1], false);
+            c[k] = std::move(t);
+        }
+        mul_small(c[0], -x[i]);
+        sadd(c[0], w[i], false);
+    }
+
+    // 各系数都非负，按 B^(i*m) 错位累加
+    size_t rn = an + bn;
+    std::fill(r, r + rn, (limb)0);
+    for (int i = 0; i <= n; i++)
+    {
+        const BigInt& ci = i < n ? c[i] : top;
+        if (ci.isZero()) continue;
+        size_t off = i * m;
+        add(r + off, r + off, rn - off, ci.d.data(), ci.size());
+    }
+}
+
+// ---------- 数论变换(NTT)乘法 ----------
+// 每个肢拆成两个 32 位系数，在三个 NTT 友好素数下分别做循环卷积，再用中国剩余定理合并。
+// 三个素数之积约为 2^86，卷积长度不超过 2^23 时每个系数都不会溢出。
+// 正变换用 DIF、逆变换用 DIT，两者的位反转顺序互相抵消，不需要单独重排；蝶形走运行时分派的向量内核。
+
+// 三个素数依次为 119*2^23+1、5*2^25+1、7*2^26+1，原根都是 3
+const std::uint32_t NTT_P0 = 998244353u;
+const std::uint32_t NTT_P1 = 167772161u;
+const std::uint32_t NTT_P2 = 469762049u;
+const std::uint32_t NTT_G = 3u;
+
+const size_t NTT_MAX_LEN = (size_t)1 << 23;
+
+// 不超过这个长度的变换直接在整段系数上做基 2 蝶形，整段放得进 L2；更长的按四步法拆成行和列
+const size_t NTT_BLOCK_LEN = (size_t)1 << 16;
+// 四步法列变换每次处理的列数，每行 256 字节即四条缓存行
+const size_t NTT_COL_BLOCK = 64;
+
+std::uint32_t pow_mod(std::uint32_t a, std::uint64_t e, std::uint32_t m)
+{
+    std::uint64_t r = 1, x = a;
+    while (e)
+    {
+        if (e & 1) r = r * x % m;
+        x = x * x % m;
+        e >>= 1;
+    }
+    return (std::uint32_t)r;
+}
+
+// 各级蝶形的单位根表(Montgomery 形式)：tab[h + k] = w_2h^k，0 <= k < h，h 取遍小于 len 的 2 的幂
+std::vector<std::uint32_t> ntt_roots(size_t len, bool invert, const NttMod& m)
+{
+    std::vector<std::uint32_t> tab(std::max(len, (size_t)2));
+    for (size_t h = 1; h < len; h <<= 1)
+    {
+        std::uint32_t w = pow_mod(NTT_G, (m.p - 1) / (2 * h), m.p);
+        if (invert) w = pow_mod(w, m.p - 2, m.p);
+        std::uint32_t wm = mont_mul(w, m.r2, m), cur = m.r1;
+        for (size_t k = 0; k < h; k++)
+        {
+            tab[h + k] = cur;
+            cur = mont_mul(cur, wm, m);
+        }
+    }
+    return tab;
+}
+
+// 连续 len 个系数的 DIF 变换：输入自然顺序，输出位反转顺序
+void ntt_dif_block(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    for (size_t h = len / 2; h >= NTT_TAIL_HALF; h >>= 1)
+    {
+        for (size_t i = 0; i < len; i += 2 * h) g_kernels.ntt_dif(a + i, a + i + h, roots + h, 1, h, m);
+    }
+    g_kernels.ntt_dif_tail(a, len, roots, m);
+}
+
+// 连续 len 个系数的 DIT 变换：输入位反转顺序，输出自然顺序，正好抵消 ntt_dif_block 的重排
+void ntt_dit_block(std::uint32_t* a, size_t len, const std::uint32_t* roots, const NttMod& m)
+{
+    g_kernels.ntt_dit_head(a, len, roots, m);
+    for (size_t h = NTT_TAIL_HALF; h < len; h <<= 1)
+    {
+        for (size_t i = 0; i < len; i += 2 * h) g_kernels.ntt_dit(a + i, a + i + h, roots + h, 1, h, m);
+    }
+}
+
+// 从 a 开始的 NTT_COL_BLOCK 列(行距 stride)上各做一次长度 rows 的变换，同一对行的这些列共用一个单位根。
+// 行距是 2 的幂，直接在原地做会让各行落在同几个缓存组里互相挤掉，所以先把这一块列抄进连续的 buf，
+// 变换完再抄回去；buf 为 rows 行 x 一块列，放得进 L2。
+void ntt_dif_cols(std::uint32_t* a, size_t rows, size_t stride, const std::uint32_t* roots, const NttMod& m, std::uint32_t* buf)
+{
+    const size_t cb = NTT_COL_BLOCK;
+    for (size_t i = 0; i < rows; i++) std::memcpy(buf + i * cb, a + i * stride, cb * sizeof(std::uint32_t));
+    for (size_t h = rows / 2; h >= 1; h >>= 1)
+    {
+        for (size_t i = 0; i < rows; i += 2 * h)
+        {
+            for (size_t k = 0; k < h; k++) g_kernels.ntt_dif(buf + (i + k) * cb, buf + (i + k + h) * cb, roots + h + k, 0, cb, m);
+        }
+    }
+    for (size_t i = 0; i < rows; i++) std::memcpy(a + i * stride, buf + i * cb, cb * sizeof(std::uint32_t));
+}
+
+void ntt_dit_cols(std::uint32_t* a, size_t rows, size_t stride, const std::uint32_t* roots, const NttMod& m, std::uint32_t* buf)
+{
+    const size_t cb = NTT_COL_BLOCK;
+    for (size_t i = 0; i < rows; i++) std::memcpy(buf + i * cb, a + i * stride, cb * sizeof(std::uint32_t));
+    for (size_t h = 1; h < rows; h <<= 1)
+    {
+        for (size_t i = 0; i < rows; i += 2 * h)
+        {
+            for (size_t k = 0; k < h; k++) g_kernels.ntt_dit(buf + (i + k) * cb, buf + (i + k + h) * cb, roots + h + k, 0, cb, m);
+        }
+    }
+    for (size_t i = 0; i < rows; i++) std::memcpy(a + i * stride, buf + i * cb, cb * sizeof(std::uint32_t));
+}
+
+// 一次卷积用到的模数、长度和单位根表。长度 n 超过 NTT_BLOCK_LEN 时按四步法把系数看成 rows 行 cols 列：
+// 先对每列做长度 rows 的变换，乘上旋转因子，再对每行做长度 cols 的变换。
+// 两遍都只在 L2 放得下的范围内来回访问，行与行、列块与列块之间互不依赖，可以分给多个线程。
+// 正变换的输出顺序被打乱了，但逐点相乘不关心顺序，逆变换按相反的步骤恰好还原。
+struct NttPlan
+{
+    NttMod m;
+    size_t n, rows, cols;
+    unsigned log_rows;
+    std::uint32_t w, iw;                                   // n 次本原单位根及其逆，普通形式
+    std::vector<std::uint32_t> fwd_r, inv_r, fwd_c, inv_c; // 列变换(长度 rows)和行变换(长度 cols)的单位根表
+    bool parallel;
+
+    NttPlan(std::uint32_t p, size_t len, bool par)
+        : m(make_ntt_mod(p)), n(len), rows(1), cols(len), log_rows(0), parallel(par)
+    {
+        if (n > NTT_BLOCK_LEN)
+        {
+            while (rows * rows * 2 <= n)
+            {
+                rows <<= 1;
+                log_rows++;
+            }
+            cols = n / rows;
+            fwd_r = ntt_roots(rows, false, m);
+            inv_r = ntt_roots(rows, true, m);
+        }
+        fwd_c = ntt_roots(cols, false, m);
+        inv_c = ntt_roots(cols, true, m);
+        w = pow_mod(NTT_G, (p - 1) / n, p);
+        iw = pow_mod(w, p - 2, p);
+    }
+
+    // 列变换后第 r 行对应频率 bitrev(r)，该行第 c 个系数乘上 w^(bitrev(r)*c)。
+    // 旋转因子按倍增生成：tw[L .. 2L) = tw[0 .. L) * base^L，每一步都是一次向量化的逐点乘
+    void twiddle_row(std::uint32_t* row, size_t r, std::uint32_t root, std::vector<std::uint32_t>& tw) const
+    {
+        size_t k = 0;
+        for (unsigned i = 0; i < log_rows; i++) k |= ((r >> i) & 1) << (log_rows - 1 - i);
+        std::uint32_t step = mont_mul(pow_mod(root, k, m.p), m.r2, m);
+        tw[0] = m.r1;
+        for (size_t len = 1; len < cols; len <<= 1)
+        {
+            g_kernels.ntt_mul(tw.data() + len, tw.data(), &step, 0, len, m);
+            step = mont_mul(step, step, m);
+        }
+        g_kernels.ntt_mul(row, row, tw.data(), 1, cols, m);
+    }
+
+    void forward(std::uint32_t* a) const
+    {
+        if (rows == 1)
+        {
+            ntt_dif_block(a, n, fwd_c.data(), m);
+            return;
+        }
+        par_for(cols / NTT_COL_BLOCK, parallel, [&](size_t b, size_t e) {
+            std::vector<std::uint32_t> buf(rows * NTT_COL_BLOCK);
+            for (size_t j = b; j < e; j++) ntt_dif_cols(a + j * NTT_COL_BLOCK, rows, cols, fwd_r.data(), m, buf.data());
+        });
+        par_for(rows, parallel, [&](size_t b, size_t e) {
+            std::vector<std::uint32_t> tw(cols);
+            for (size_t r = b; r < e; r++)
+            {
+                twiddle_row(a + r * cols, r, w, tw);
+                ntt_dif_block(a + r * cols, cols, fwd_c.data(), m);
+            }
+        });
+    }
+
+    // 结果是真正逆变换的 n 倍，由调用方在逐点相乘时一并除掉
+    void inverse(std::uint32_t* a) const
+    {
+        if (rows == 1)
+        {
+            ntt_dit_block(a, n, inv_c.data(), m);
+            return;
+        }
+        par_for(rows, parallel, [&](size_t b, size_t e) {
+            std::vector<std::uint32_t> tw(cols);
+            for (size_t r = b; r < e; r++)
+            {
+                ntt_dit_block(a + r * cols, cols, inv_c.data(), m);
+                twiddle_row(a + r * cols, r, iw, tw);
+            }
+        });
+        par_for(cols / NTT_COL_BLOCK, parallel, [&](size_t b, size_t e) {
+            std::vector<std::uint32_t> buf(rows * NTT_COL_BLOCK);
+            for (size_t j = b; j < e; j++) ntt_dit_cols(a + j * NTT_COL_BLOCK, rows, cols, inv_r.data(), m, buf.data());
+        });
+    }
+};
+
+// 乘积的 32 位系数个数不超过 NTT_MAX_LEN 时才能使用 NTT
+bool ntt_fits(size_t an, size_t bn)
+{
+    return 2 * (an + bn) <= NTT_MAX_LEN;
+}
+
+// 把肢拆成 32 位系数并对模数取余：x < 2^32 时 x * (R mod p) / R 恰好就是 x mod p
+void split32(std::vector<std::uint32_t>& f, const limb* a, size_t n, const NttMod& m)
+{
+    std::fill(f.begin() + 2 * n, f.end(), 0u);
+    for (size_t i = 0; i < n; i++)
+    {
+        f[2 * i] = (std::uint32_t)a[i];
+        f[2 * i + 1] = (std::uint32_t)(a[i] >> 32);
+    }
+    g_kernels.ntt_mul(f.data(), f.data(), &m.r1, 0, 2 * n, m);
+}
+
+// 在模 p 下计算 a、b 的循环卷积，长度为 f.size()；a、b 相同时只做一次正变换
+void ntt_conv(std::vector<std::uint32_t>& f, const limb* a, size_t an, const limb* b, size_t bn, std::uint32_t p, bool par)
+{
+    const NttPlan plan(p, f.size(), par);
+    const NttMod& m = plan.m;
+    split32(f, a, an, m);
+    plan.forward(f.data());
+
+    // 两次 Montgomery 乘法各除掉一个 R，scale = R^2/n 同时补回 R 并除掉逆变换多出的 n 倍
+    std::uint32_t scale = pow_mod((std::uint32_t)(f.size() % p), p - 2, p);
+    scale = mont_mul(mont_mul(scale, m.r2, m), m.r2, m);
+    std::vector<std::uint32_t> g;
+    if (!(a == b && an == bn))
+    {
+        g.resize(f.size());
+        split32(g, b, bn, m);
+        plan.forward(g.data());
+    }
+    const std::uint32_t* gp = g.empty() ? f.data() : g.data();
+    par_for(f.size() / NTT_COL_BLOCK, par, [&](size_t lo, size_t hi) {
+        std::uint32_t* x = f.data() + lo * NTT_COL_BLOCK;
+        size_t len = (hi - lo) * NTT_COL_BLOCK;
+        g_kernels.ntt_mul(x, x, gp + lo * NTT_COL_BLOCK, 1, len, m);
+        g_kernels.ntt_mul(x, x, &scale, 0, len, m);
+    });
+    plan.inverse(f.data());
+}
+
+// r[0 .. an+bn) = a * b
+void mul_ntt(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    size_t need = 2 * (an + bn), n = 1;
+    while (n < need) n <<= 1;
+
+    // 三个素数下的卷积各自独立
+    std::vector<std::uint32_t> res[3];
+    for (int k = 0; k < 3; k++) res[k].resize(n);
+    bool par = par_worth(std::min(an, bn));
+    TaskGroup g(par);
+    g.run([&] { ntt_conv(res[0], a, an, b, bn, NTT_P0, par); });
+    g.run([&] { ntt_conv(res[1], a, an, b, bn, NTT_P1, par); });
+    g.run([&] { ntt_conv(res[2], a, an, b, bn, NTT_P2, par); });
+    g.wait();
+
+    // 中国剩余定理：x = r0 + p0 * t1 + p0 * p1 * t2。
+    // 先逐个系数求出 t1、t2(各系数独立，可以并行，取模都用 Montgomery 乘法)，写回 res[1]、res[2]，再串行累加进位
+    const std::uint64_t p0 = NTT_P0, p1 = NTT_P1, p2 = NTT_P2;
+    const std::uint64_t p01 = p0 * p1;
+    const NttMod m1 = make_ntt_mod(NTT_P1), m2 = make_ntt_mod(NTT_P2);
+    const std::uint32_t inv01 = mont_mul(pow_mod((std::uint32_t)(p0 % p1), p1 - 2, (std::uint32_t)p1), m1.r2, m1);
+    const std::uint32_t p0_2 = mont_mul((std::uint32_t)(p0 % p2), m2.r2, m2);
+    const std::uint32_t inv012 = mont_mul(pow_mod((std::uint32_t)(p01 % p2), p2 - 2, (std::uint32_t)p2), m2.r2, m2);
+    par_for(need, par, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+        {
+            std::uint32_t r0 = res[0][i];
+            std::uint32_t t1 = mont_mul(sub_mod(res[1][i], mont_mul(r0, m1.r1, m1), NTT_P1), inv01, m1);
+            std::uint32_t x01 = add_mod(mont_mul(r0, m2.r1, m2), mont_mul(t1, p0_2, m2), NTT_P2);
+            res[1][i] = t1;
+            res[2][i] = mont_mul(sub_mod(res[2][i], x01, NTT_P2), inv012, m2);
+        }
+    });
+
+    dlimb carry = 0;
+    for (size_t i = 0; i < need; i++)
+    {
+        carry += (dlimb)p01 * res[2][i] + (res[0][i] + p0 * res[1][i]);
+
+        std::uint32_t word = (std::uint32_t)carry;
+        carry >>= 32;
+        if (i % 2 == 0) r[i / 2] = word;
+        else r[i / 2] |= (limb)word << 32;
+    }
+}
+
+// Karatsuba 平方：a^2 = z2*B^2h + (z0 + z2 - (a0-a1)^2)*B^h + z0，三次递归都是平方
+void sqr_karatsuba(limb* r, const limb* a, size_t n)
+{
+    size_t h = (n + 1) / 2;
+
+    std::vector<limb> t(3 * h);
+    limb* da = t.data();
+    limb* z1 = da + h;
+    abs_diff(da, a, h, a + h, n - h);
+
+    TaskGroup g(par_worth(n));
+    g.run([=] { sqr(r, a, h); });
+    g.run([=] { sqr(r + 2 * h, a + h, n - h); });
+    g.run([=] { sqr(z1, da, h); });
+    g.wait();
+
+    std::vector<limb> mid(2 * h + 1);
+    mid[2 * h] = add(mid.data(), r, 2 * h, r + 2 * h, 2 * n - 2 * h);
+    sub(mid.data(), mid.data(), 2 * h + 1, z1, 2 * h);
+
+    size_t mn = std::min(2 * h + 1, 2 * n - h);
+    add(r + h, r + h, 2 * n - h, mid.data(), mn);
+}
+
+// 操作数长度悬殊时，把长的一方按短的一方的长度切块分别相乘再累加
+void mul_unbalanced(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    std::fill(r, r + an + bn, (limb)0);
+
+    // 并行时各块的乘积先分别算进自己的缓冲区，再串行错位累加
+    size_t k = (an + bn - 1) / bn;
+    if (k > 1 && par_worth(bn))
+    {
+        std::vector<std::vector<limb> > parts(k);
+        TaskGroup g(true);
+        for (size_t j = 0; j < k; j++)
+        {
+            g.run([&, j] {
+                size_t i = j * bn, n = std::min(bn, an - i);
+                parts[j].resize(n + bn);
+                mul(parts[j].data(), b, bn, a + i, n);
+            });
+        }
+        g.wait();
+        for (size_t j = 0; j < k; j++)
+        {
+            size_t i = j * bn;
+            add(r + i, r + i, an + bn - i, parts[j].data(), parts[j].size());
+        }
+        return;
+    }
+
+    std::vector<limb> t(2 * bn);
+    for (size_t i = 0; i < an; i += bn)
+    {
+        size_t n = std::min(bn, an - i);
+        mul(t.data(), b, bn, a + i, n);
+        add(r + i, r + i, an + bn - i, t.data(), n + bn);
+    }
+}
+
+// r[0 .. an+bn) = a * b，r 不能与 a、b 重叠，an、bn 均不为 0
+void mul(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    if (a == b && an == bn)
+    {
+        sqr(r, a, an);
+        return;
+    }
+    if (an < bn)
+    {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+
+    if (bn < KARATSUBA_THRESHOLD) mul_basecase(r, a, an, b, bn);
+    else if (bn < TOOM3_THRESHOLD)
+    {
+        if (2 * bn > an + 1) mul_karatsuba(r, a, an, b, bn);
+        else mul_unbalanced(r, a, an, b, bn);
+    }
+    else if (bn >= NTT_THRESHOLD && ntt_fits(an, bn)) mul_ntt(r, a, an, b, bn);
+    else if (4 * an < 5 * bn)
+    {
+        if (bn < TOOM4_THRESHOLD) mul_toom(r, a, an, b, bn, 3, 3);
+        else mul_toom(r, a, an, b, bn, 4, 4);
+    }
+    else if (4 * an < 7 * bn) mul_toom(r, a, an, b, bn, 3, 2);
+    else if (2 * an < 5 * bn) mul_toom(r, a, an, b, bn, 4, 2);
+    else mul_unbalanced(r, a, an, b, bn);
+}
+
+// r[0 .. 2n) = a^2，r 不能与 a 重叠，n 不为 0
+void sqr(limb* r, const limb* a, size_t n)
+{
+    if (n < SQR_KARATSUBA_THRESHOLD) sqr_basecase(r, a, n);
+    else if (n < TOOM3_THRESHOLD) sqr_karatsuba(r, a, n);
+    else if (n >= NTT_THRESHOLD && ntt_fits(n, n)) mul_ntt(r, a, n, a, n);
+    else if (n < TOOM4_THRESHOLD) mul_toom(r, a, n, a, n, 3, 3);
+    else mul_toom(r, a, n, a, n, 4, 4);
+}
+
+// ---------- 除法 ----------
+
+// 除数和商都不少于对应肢数时依次改用 Burnikel-Ziegler 递归除法、牛顿迭代求倒数的除法
+const size_t DIV_BZ_THRESHOLD = 80;
+const size_t DIV_NEWTON_THRESHOLD = 8000;
+// 倒数递归到这个长度以下时直接用长除法求
+const size_t NEWTON_BASE = 64;
+
+void divrem(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn);
+void divrem_knuth(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn);
+int check(const BigInt& a, const BigInt& b);
+
+// Knuth 算法 D。v 已规格化(最高肢的最高位为 1)且 vn >= 2，u 共 un+1 个肢(u[un] 为规格化时移出的高位)。
+// 商写入 q[0 .. un-vn]，余数留在 u[0 .. vn)。
+void divrem_basecase(limb* q, limb* u, size_t un, const limb* v, size_t vn)
+{
+    limb v1 = v[vn - 1], v0 = v[vn - 2];
+    for (size_t j = un - vn + 1; j-- > 0; )
+    {
+        limb u2 = u[j + vn], u1 = u[j + vn - 1], u0 = u[j + vn - 2];
+
+        // 用被除数的前三个肢和除数的前两个肢估商，估出的 qhat 至多比真实值大 1
+        limb qhat, rhat;
+        bool over;
+        if (u2 >= v1)
+        {
+            qhat = ~(limb)0;
+            rhat = u1 + v1;
+            over = rhat < u1;
+        }
+        else
+        {
+            dlimb num = ((dlimb)u2 << LIMB_BITS) | u1;
+            qhat = (limb)(num / v1);
+            rhat = (limb)(num % v1);
+            over = false;
+        }
+        while (!over && (dlimb)qhat * v0 > (((dlimb)rhat << LIMB_BITS) | u0))
+        {
+            qhat--;
+            rhat += v1;
+            over = rhat < v1;
+        }
+
+        limb borrow = submul_1(u + j, v, vn, qhat);
+        if (u[j + vn] < borrow)
+        {
+            qhat--;
+            u[j + vn] += add_n(u + j, u + j, v, vn) - borrow;
+        }
+        else
+        {
+            u[j + vn] -= borrow;
+        }
+        q[j] = qhat;
+    }
+}
+
+// a = a * B^k
+void shift_limbs_up(BigInt& a, size_t k)
+{
+    if (a.isZero() || k == 0) return;
+    a.d.resize(a.size() + k);
+    std::copy_backward(a.d.begin(), a.d.end() - k, a.d.end());
+    std::fill(a.d.begin(), a.d.begin() + k, (limb)0);
+}
+
+// a = a / B^k (按绝对值截断)
+void shift_limbs_down(BigInt& a, size_t k)
+{
+    if (k >= a.size())
+    {
+        a.d.clear();
+        a.neg = false;
+        return;
+    }
+    std::copy(a.d.begin() + k, a.d.end(), a.d.begin());
+    a.d.resize(a.size() - k);
+}
+
+// 求规格化的 n 肢数 v 的近似倒数 X ≈ B^(2n) / v，误差在几个单位以内。
+// 先递归求出高 h 肢的倒数 Xh，以 X0 = Xh * B^(n-h) 为初值做一次牛顿迭代
+// X1 = X0 + X0 * (B^(2n) - v*X0) / B^(2n)，精度大约翻倍，所以每层只需要一半的长度。
+// X0 的低 n-h 肢全是 0，两次乘法都直接用 Xh 来做。
+BigInt reciprocal(const limb* v, size_t n)
+{
+    if (n <= NEWTON_BASE)
+    {
+        std::vector<limb> num(2 * n + 1, 0), rem(n);
+        num[2 * n] = 1;
+        BigInt x;
+        x.d.resize(n + 2);
+        divrem_knuth(x.d.data(), rem.data(), num.data(), 2 * n + 1, v, n);
+        trim(x);
+        return x;
+    }
+
+    size_t h = (n + 1) / 2 + 2;
+    BigInt xh = reciprocal(v + n - h, h);
+
+    // e = B^(2n) - v*X0 = B^(n-h) * (B^(n+h) - v*Xh)
+    BigInt e;
+    e.d.assign(n + h + 1, 0);
+    e.d[n + h] = 1;
+    sadd(e, smul(make_big(v, n), xh), true);
+
+    // X0 * (B^(n-h) * e) / B^(2n) = Xh * e / B^(2h)
+    BigInt corr = smul(xh, e);
+    shift_limbs_down(corr, 2 * h);
+    trim(corr);
+
+    BigInt x = std::move(xh);
+    shift_limbs_up(x, n - h);
+    sadd(x, corr, false);
+    return x;
+}
+
+// 牛顿迭代除法：求出除数的倒数后，以 n 肢为一块从高到低试商，
+// 每块的商由被除数的高位乘倒数得到，再用余数校正到准确值。
+void divrem_newton(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    size_t n = bn;
+    int sh = clz_limb(b[bn - 1]);
+    std::vector<limb> u(an + 1), v(bn);
+    if (sh)
+    {
+        lshift(v.data(), b, bn, sh);
+        u[an] = lshift(u.data(), a, an, sh);
+    }
+    else
+    {
+        std::copy(b, b + bn, v.begin());
+        std::copy(a, a + an, u.begin());
+    }
+
+    BigInt x = reciprocal(v.data(), n);
+    BigInt bv = make_big(v.data(), n);
+    BigInt one(1);
+    size_t qn = an - bn + 1;
+    std::fill(q, q + qn, (limb)0);
+
+    // 第一块取 n 到 2n 个肢，之后每块 n 个肢，保证每块都小于 B^(2n)
+    size_t un = an + 1;
+    while (u[un - 1] == 0) un--;
+    size_t blocks = un > 2 * n ? (un - n - 1) / n : 0;
+    size_t take = un - blocks * n;
+
+    BigInt rem;
+    for (size_t pos = un; pos > 0; take = n)
+    {
+        pos -= take;
+
+        // cur = rem * B^take + u[pos .. pos+take)
+        BigInt cur = std::move(rem);
+        shift_limbs_up(cur, take);
+        if (cur.isZero()) cur.d.assign(u.data() + pos, u.data() + pos + take);
+        else std::copy(u.begin() + pos, u.begin() + pos + take, cur.d.begin());
+        trim(cur);
+
+        if (check(cur, bv) == 1)
+        {
+            rem = std::move(cur);
+            continue;
+        }
+
+        BigInt top = cur;
+        shift_limbs_down(top, n - 1);
+        BigInt qq = smul(top, x);
+        shift_limbs_down(qq, n + 1);
+        trim(qq);
+
+        rem = std::move(cur);
+        sadd(rem, smul(qq, bv), true);
+        while (rem.neg)
+        {
+            sadd(qq, one, true);
+            sadd(rem, bv, false);
+        }
+        while (check(rem, bv) != 1)
+        {
+            sadd(qq, one, false);
+            sadd(rem, bv, true);
+        }
+
+        for (size_t i = 0; i < qq.size(); i++)
+        {
+            if (pos + i < qn) q[pos + i] = qq.d[i];
+        }
+    }
+
+    std::fill(r, r + bn, (limb)0);
+    std::copy(rem.d.begin(), rem.d.end(), r);
+    if (sh) rshift(r, r, bn, sh);
+}
+
+// a 的第 lo 肢起共 n 个肢，超出部分按 0 处理
+BigInt slice(const BigInt& a, size_t lo, size_t n)
+{
+    if (lo >= a.size()) return BigInt();
+    return make_big(a.d.data() + lo, std::min(n, a.size() - lo));
+}
+
+// hi * B^k + lo，要求 lo < B^k
+BigInt join(const BigInt& hi, const BigInt& lo, size_t k)
+{
+    BigInt r = hi;
+    shift_limbs_up(r, k);
+    if (r.isZero()) return lo;
+    std::copy(lo.d.begin(), lo.d.end(), r.d.begin());
+    return r;
+}
+
+void div2n1n(const BigInt& a, const BigInt& b, size_t n, BigInt& q, BigInt& r);
+
+// Burnikel-Ziegler 的 3h/2h 步：a 为 3h 个肢，b 为规格化的 2h 个肢，要求 a < B^h * b。
+// 先用 b 的高半部分递归试商，再用低半部分校正，商至多偏大 2。
+void div3n2n(const BigInt& a, const BigInt& b, size_t h, BigInt& q, BigInt& r)
+{
+    BigInt a12 = slice(a, h, 2 * h), a3 = slice(a, 0, h);
+    BigInt b1 = slice(b, h, h), b2 = slice(b, 0, h);
+
+    BigInt c;
+    if (check(slice(a, 2 * h, h), b1) == 1)
+    {
+        div2n1n(a12, b1, h, q, c);
+    }
+    else
+    {
+        // q = B^h - 1，c = a12 - q*b1 = a12 - b1*B^h + b1
+        q.d.assign(h, ~(limb)0);
+        q.neg = false;
+        c = a12;
+        sadd(c, join(b1, BigInt(), h), true);
+        sadd(c, b1, false);
+    }
+
+    r = join(c, a3, h);
+    sadd(r, smul(q, b2), true);
+
+    BigInt one(1);
+    while (r.neg)
+    {
+        sadd(q, one, true);
+        sadd(r, b, false);
+    }
+}
+
+// Burnikel-Ziegler 的 2n/1n 步：a < B^n * b，b 为规格化的 n 个肢。
+// n 为奇数或不够大时退回长除法。
+void div2n1n(const BigInt& a, const BigInt& b, size_t n, BigInt& q, BigInt& r)
+{
+    if (check(a, b) == 1)
+    {
+        q = BigInt();
+        r = a;
+        return;
+    }
+    if (n % 2 || n < DIV_BZ_THRESHOLD)
+    {
+        q.d.assign(a.size() - n + 1, 0);
+        r.d.assign(n, 0);
+        q.neg = r.neg = false;
+        divrem_knuth(q.d.data(), r.d.data(), a.d.data(), a.size(), b.d.data(), n);
+        trim(q);
+        trim(r);
+        return;
+    }
+
+    size_t h = n / 2;
+    BigInt q1, q2, r1;
+    div3n2n(slice(a, h, 3 * h), b, h, q1, r1);
+    div3n2n(join(r1, slice(a, 0, h), h), b, h, q2, r);
+    q = join(q1, q2, h);
+}
+
+// Burnikel-Ziegler 递归除法。先把除数补齐到 m * 2^k 个肢(m < DIV_BZ_THRESHOLD)并规格化，
+// 被除数做同样的移位，再以 n 肢为一块从高到低做 2n/1n 除法。
+void divrem_bz(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    size_t m = bn, k = 0;
+    while (m >= DIV_BZ_THRESHOLD)
+    {
+        m = (m + 1) / 2;
+        k++;
+    }
+    size_t n = m << k;
+    size_t pad = n - bn;
+    int sh = clz_limb(b[bn - 1]);
+
+    // 除数和被除数同时乘以 B^pad * 2^sh，商不变
+    BigInt bv, av;
+    bv.d.assign(n, 0);
+    av.d.assign(an + pad + 1, 0);
+    if (sh)
+    {
+        lshift(bv.d.data() + pad, b, bn, sh);
+        av.d[an + pad] = lshift(av.d.data() + pad, a, an, sh);
+    }
+    else
+    {
+        std::copy(b, b + bn, bv.d.begin() + pad);
+        std::copy(a, a + an, av.d.begin() + pad);
+    }
+    trim(av);
+
+    // 块数 t 要保证最高块的最高位为 0，这样最高块一定小于除数
+    size_t t = bit_length(av) / (n * LIMB_BITS) + 1;
+    if (t < 2) t = 2;
+
+    size_t qn = an - bn + 1;
+    std::fill(q, q + qn, (limb)0);
+
+    BigInt z = slice(av, (t - 2) * n, 2 * n), qi, ri;
+    for (size_t i = t - 1; i-- > 0; )
+    {
+        div2n1n(z, bv, n, qi, ri);
+        for (size_t j = 0; j < qi.size(); j++)
+        {
+            if (i * n + j < qn) q[i * n + j] = qi.d[j];
+        }
+        if (i > 0) z = join(ri, slice(av, (i - 1) * n, n), n);
+    }
+
+    // 余数除以 B^pad * 2^sh 还原
+    std::fill(r, r + bn, (limb)0);
+    for (size_t j = pad; j < ri.size(); j++) r[j - pad] = ri.d[j];
+    if (sh) rshift(r, r, bn, sh);
+}
+
+// 规格化后调用 Knuth 算法 D
+void divrem_knuth(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    int sh = clz_limb(b[bn - 1]);
+    LimbVec u(an + 1), v(bn);
+    if (sh)
+    {
+        lshift(v.data(), b, bn, sh);
+        u[an] = lshift(u.data(), a, an, sh);
+    }
+    else
+    {
+        std::copy(b, b + bn, v.begin());
+        std::copy(a, a + an, u.begin());
+    }
+
+    divrem_basecase(q, u.data(), an, v.data(), bn);
+
+    if (sh) rshift(r, u.data(), bn, sh);
+    else std::copy(u.begin(), u.begin() + bn, r);
+}
+
+// q[0 .. an-bn] = a / b，r[0 .. bn) = a % b，要求 an >= bn 且 b 的最高肢不为 0
+void divrem(limb* q, limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    size_t qn = an - bn + 1;
+    if (bn == 1) r[0] = divrem_1(q, a, an, b[0]);
+    else if (bn >= DIV_NEWTON_THRESHOLD && qn >= DIV_NEWTON_THRESHOLD) divrem_newton(q, r, a, an, b, bn);
+    else if (bn >= DIV_BZ_THRESHOLD && qn >= DIV_BZ_THRESHOLD) divrem_bz(q, r, a, an, b, bn);
+    else divrem_knuth(q, r, a, an, b, bn);
+}
+
+// ---------- 十进制转换 ----------
+
+const limb DEC_BASE = 10000000000000000000ULL;   // 10^19，一个肢能放下的最大 10 的幂
+const int DEC_DIGITS = 19;
+
+// 可选的负号后跟至少一位数字
+bool is_number(const std::string& s)
+{
+    size_t start = !s.empty() && s[0] == '-';
+    return s.size() > start && s.find_first_not_of("0123456789", start) == std::string::npos;
+}
+
+// ---------- 十进制转换的分治 ----------
+// 把十进制数看成以 10^19 为基的“块”序列 c[0..m)(小端)，取 k 为小于 m 的最大 2 的幂，
+// 值 = (c[k..m) 的值) * (10^19)^k + (c[0..k) 的值)，两半递归求，合并用快速乘法，
+// 总代价是 O(M(n) log n)。块数不超过 DEC_DC_THRESHOLD 时逐块乘 10^19 再加，O(n^2) 但常数小。
+//
+// (10^19)^(2^i) = 2^(19*2^i) * 5^(19*2^i)，低位有大约 30% 的肢是 0。
+// 缓存时把这些 0 肢剥掉记成 v * B^shift，乘的时候只乘 v，再整体左移 shift 个肢。
+const size_t DEC_DC_THRESHOLD = 40;
+
+struct DecPow
+{
+    BigInt v;
+    size_t shift;
+};
+
+// g_dec_pows[i] 表示 (10^19)^(2^i)，前 g_dec_ready 层已经算好，由 dec_pows_upto 按需补齐。
+// 多个线程会同时做十进制转换：补齐在锁内进行，算好的层此后只读，
+// 读者看到 g_dec_ready > lev 之后即可不加锁地访问 g_dec_pows[lev]。
+const size_t DEC_MAX_LEVELS = 48;
+
+DecPow g_dec_pows[DEC_MAX_LEVELS];
+std::atomic<size_t> g_dec_ready(0);
+std::mutex g_dec_mutex;
+
+void dec_pows_upto(size_t lev)
+{
+    if (g_dec_ready.load(std::memory_order_acquire) > lev) return;
+
+    std::lock_guard<std::mutex> lock(g_dec_mutex);
+    size_t n = g_dec_ready.load(std::memory_order_relaxed);
+    if (n == 0)
+    {
+        g_dec_pows[0].v = BigInt(DEC_BASE);
+        g_dec_pows[0].shift = 0;
+        n = 1;
+    }
+    for (; n <= lev; n++)
+    {
+        const DecPow& last = g_dec_pows[n - 1];
+        DecPow& p = g_dec_pows[n];
+        p.v.d.resize(2 * last.v.size());
+        sqr(p.v.d.data(), last.v.d.data(), last.v.size());
+        trim(p.v);
+        p.shift = 2 * last.shift;
+        size_t z = 0;
+        while (p.v.d[z] == 0) z++;
+        shift_limbs_down(p.v, z);
+        p.shift += z;
+    }
+    g_dec_ready.store(n, std::memory_order_release);
+}
+
+// 块数 m 需要的最高层：最大的 lev 使 2^lev < m
+size_t dec_level(size_t m)
+{
+    size_t lev = 0;
+    while (((size_t)2 << lev) < m) lev++;
+    return lev;
+}
+
+// r = c[0..m) 按 10^19 进制的值；调用前 dec_pows_upto(dec_level(m)) 已经做过
+void dec_to_limbs(BigInt& r, const limb* c, size_t m)
+{
+    r.neg = false;
+    if (m <= DEC_DC_THRESHOLD)
+    {
+        r.d.clear();
+        r.d.reserve(m);
+        for (size_t i = m; i-- > 0; )
+        {
+            limb carry = mul_1(r.d.data(), r.d.data(), r.d.size(), DEC_BASE);
+            if (carry) r.d.push_back(carry);
+            if (c[i])
+            {
+                if (r.d.empty()) r.d.push_back(0);
+                carry = add(r.d.data(), r.d.data(), r.d.size(), &c[i], 1);
+                if (carry) r.d.push_back(carry);
+            }
+        }
+        return;
+    }
+
+    size_t lev = dec_level(m);
+    size_t k = (size_t)1 << lev;
+    BigInt hi, lo;
+    dec_to_limbs(hi, c + k, m - k);
+    dec_to_limbs(lo, c, k);
+    if (hi.isZero())
+    {
+        r = std::move(lo);
+        return;
+    }
+
+    // r = hi * v * B^shift + lo；lo < v * B^shift，所以 lo 只有 shift 以上的部分需要做加法
+    const DecPow& p = g_dec_pows[lev];
+    size_t z = p.shift, hn = hi.size(), vn = p.v.size();
+    size_t rn = z + hn + vn + 1;
+    r.d.resize(rn);
+    mul(r.d.data() + z, hi.d.data(), hn, p.v.d.data(), vn);
+    r.d[rn - 1] = 0;
+    size_t low = std::min(z, lo.size());
+    std::copy(lo.d.data(), lo.d.data() + low, r.d.data());
+    std::fill(r.d.data() + low, r.d.data() + z, (limb)0);
+    if (lo.size() > z)
+    {
+        r.d[rn - 1] = add(r.d.data() + z, r.d.data() + z, rn - z - 1, lo.d.data() + z, lo.size() - z);
+    }
+    trim(r);
+}
+
+// s 必须满足 is_number
+BigInt from_dec(const std::string& s)
+{
+    bool neg = s[0] == '-';
+    size_t start = neg;
+
+    // 从尾部起每 19 位切成一块，最高块可能不满
+    size_t digits = s.size() - start;
+    size_t m = (digits + DEC_DIGITS - 1) / DEC_DIGITS;
+    LimbVec c(m);
+    size_t end = s.size();
+    for (size_t i = 0; i < m; i++)
+    {
+        size_t begin = end >= start + DEC_DIGITS ? end - DEC_DIGITS : start;
+        limb val = 0;
+        for (size_t j = begin; j < end; j++) val = val * 10 + (s[j] - '0');
+        c[i] = val;
+        end = begin;
+    }
+
+    BigInt r;
+    if (m > DEC_DC_THRESHOLD) dec_pows_upto(dec_level(m));
+    dec_to_limbs(r, c.data(), m);
+    r.neg = neg;
+    trim(r);
+    return r;
+}
+
+// 两位一组的数字表："00" "01" ... "99"，一次查表写两个字符，除法次数减半
+const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// 把 x < 10^9 写成恰好 9 位(高位补 0)，只用 32 位运算
+void write_9(char* p, std::uint32_t x)
+{
+    p[0] = (char)('0' + x / 100000000);
+    x %= 100000000;
+    std::uint32_t hi = x / 10000, lo = x % 10000;
+    std::memcpy(p + 1, DIGIT_PAIRS + 2 * (hi / 100), 2);
+    std::memcpy(p + 3, DIGIT_PAIRS + 2 * (hi % 100), 2);
+    std::memcpy(p + 5, DIGIT_PAIRS + 2 * (lo / 100), 2);
+    std::memcpy(p + 7, DIGIT_PAIRS + 2 * (lo % 100), 2);
+}
+
+// 把一个 10^19 进制的块写成恰好 19 位：最高 1 位 + 两个 9 位
+void write_19(char* p, limb v)
+{
+    p[0] = (char)('0' + v / 1000000000000000000ULL);
+    v %= 1000000000000000000ULL;
+    write_9(p + 1, (std::uint32_t)(v / 1000000000));
+    write_9(p + 10, (std::uint32_t)(v % 1000000000));
+}
+
+// 把 x 写成恰好 19m 位十进制(高位补 0)放进 out，要求 x < (10^19)^m；x 的内容会被用掉。
+// 与 dec_to_limbs 对称：除以 (10^19)^k 得到的商和余数分别填前 m-k 块和后 k 块。
+// 缓存的幂是 v * B^shift，于是 x / (v * B^shift) 只需让 x 的高 n-shift 个肢除以 v，
+// 余数再接回 x 的低 shift 个肢。
+void limbs_to_dec(char* out, BigInt& x, size_t m)
+{
+    if (m <= DEC_DC_THRESHOLD)
+    {
+        char* p = out + m * DEC_DIGITS;
+        Divisor1 base(DEC_BASE);
+        for (size_t i = 0; i < m; i++)
+        {
+            limb chunk = 0;
+            if (!x.isZero())
+            {
+                chunk = divrem_1(x.d.data(), x.d.data(), x.size(), base);
+                trim(x);
+            }
+            p -= DEC_DIGITS;
+            write_19(p, chunk);
+        }
+        return;
+    }
+
+    size_t lev = dec_level(m);
+    size_t k = (size_t)1 << lev;
+    const DecPow& pw = g_dec_pows[lev];
+    size_t z = pw.shift, vn = pw.v.size();
+    BigInt q, r;
+    if (x.size() < z + vn || (x.size() == z + vn && cmp_n(x.d.data() + z, pw.v.d.data(), vn) < 0))
+    {
+        r = std::move(x);
+    }
+    else
+    {
+        size_t hn = x.size() - z;
+        q.d.resize(hn - vn + 1);
+        r.d.resize(z + vn);
+        divrem(q.d.data(), r.d.data() + z, x.d.data() + z, hn, pw.v.d.data(), vn);
+        std::copy(x.d.data(), x.d.data() + z, r.d.data());
+        trim(q);
+        trim(r);
+    }
+    x = BigInt();   // 递归下去之前先释放
+
+    limbs_to_dec(out, q, m - k);
+    limbs_to_dec(out + (m - k) * DEC_DIGITS, r, k);
+}
+
+// 把 a 的十进制表示(含负号)追加到 out 末尾。按位数上界一次把 out 扩到位，
+// 直接在里面生成，最后挪掉高位多出来的 0。
+void append_dec(std::string& out, const BigInt& a)
+{
+    if (a.isZero())
+    {
+        out += '0';
+        return;
+    }
+
+    // 十进制位数不超过 floor(bits * log10(2)) + 1，多留一位抵消浮点误差，据此定块数 m，保证 a < (10^19)^m
+    size_t digits = (size_t)((double)bit_length(a) * 0.30102999566398120) + 2;
+    size_t m = (digits + DEC_DIGITS - 1) / DEC_DIGITS;
+    if (m > DEC_DC_THRESHOLD) dec_pows_upto(dec_level(m));
+
+    size_t base = out.size();
+    out.resize(base + 1 + m * DEC_DIGITS);
+    BigInt x;
+    x.d = a.d;
+    limbs_to_dec(&out[base + 1], x, m);
+
+    size_t lead = out.find_first_not_of('0', base + 1);
+    if (a.neg) out[--lead] = '-';
+    out.erase(base, lead - base);
+}
+
+// 把 (neg ? -v : v) 追加到 out 末尾，格式与 append_dec 相同
+void append_u128(std::string& out, dlimb v, bool neg)
+{
+    char buf[3 * DEC_DIGITS];
+    char* p = buf + sizeof(buf);
+    do
+    {
+        p -= DEC_DIGITS;
+        write_19(p, (limb)(v % DEC_BASE));
+        v /= DEC_BASE;
+    } while (v);
+
+    char* end = buf + sizeof(buf);
+    while (p < end - 1 && *p == '0') p++;
+    if (neg && *p != '0') out += '-';
+    out.append(p, end);
+}
+
+// ---------- 输出缓冲 ----------
+// 结果先整段渲染进一块连续缓冲区，到批次边界(交互模式下是每条表达式结束)再用一次 fwrite 写出，
+// 不再逐段经过 iostream 的格式化，也不再每个结果都 flush。
+// std::cout 与 stdio 保持同步，所以两者混用时输出顺序不会乱，只要在读下一条输入前 flush 即可。
+class OutputBuffer
+{
+public:
+    std::string& buf() { return data; }
+
+    void put(char c) { data += c; }
+    void write(const char* s, size_t n) { data.append(s, n); }
+
+    void flush()
+    {
+        if (!data.empty())
+        {
+            std::fwrite(data.data(), 1, data.size(), stdout);
+            data.clear();
+        }
+        std::fflush(stdout);
+    }
+
+private:
+    std::string data;
+};
+
+OutputBuffer g_out;
+
 // ============================================
 // 计算器核心算法
 // ============================================
 
-int check(const std::vector<int>& a, const std::vector<int>& b)
+// 比较 a 和 b 的绝对值：a 大返回 -1，b 大返回 1，相等返回 0
+int check(const BigInt& a, const BigInt& b)
+{
+    if (a.size() > b.size()) return -1;
+    if (a.size() < b.size()) return 1;
+    return -cmp_n(a.d.data(), b.d.data(), a.size());
+}
+
+// 以下 *_to 版本把结果写进调用者提供的 r，r 可以与 a 或 b 是同一个对象(即 +=、-=、*=)。
+// r 已有的容量会被复用，调用者预留好容量后整个运算不再分配内存。
+
+// r = |a| + |b|
+void add_abs(BigInt& r, const BigInt& a, const BigInt& b)
+{
+    const BigInt& x = a.size() >= b.size() ? a : b;
+    const BigInt& y = a.size() >= b.size() ? b : a;
+    size_t xn = x.size(), yn = y.size();
+    r.d.resize(xn + 1);
+    // resize 之后再取指针：r 与 x、y 相同时底层数组可能已经搬家
+    r.d[xn] = add(r.d.data(), x.d.data(), xn, y.d.data(), yn);
+    r.neg = false;
+    trim(r);
+}
+
+// r = |a| - |b|，结果可能为负
+void sub_abs(BigInt& r, const BigInt& a, const BigInt& b)
+{
+    int cmp = check(a, b);
+    if (cmp == 0)
+    {
+        r.d.clear();
+        r.neg = false;
+        return;
+    }
+
+    const BigInt& x = cmp == 1 ? b : a;
+    const BigInt& y = cmp == 1 ? a : b;
+    size_t xn = x.size(), yn = y.size();
+    r.d.resize(xn);
+    sub(r.d.data(), x.d.data(), xn, y.d.data(), yn);
+    r.neg = false;
+    trim(r);
+    r.neg = cmp == 1;
+}
+
+// r = a + (bneg ? -|b| : |b|)，加法和减法共用
+void add_signed(BigInt& r, const BigInt& a, const BigInt& b, bool bneg)
+{
+    bool aneg = a.neg;   // r 可能就是 a，先记下符号
+    if (aneg == bneg)
+    {
+        add_abs(r, a, b);
+        r.neg = aneg && !r.isZero();
+    }
+    else
+    {
+        // 异号相加即绝对值相减，a 为负时整体取反
+        sub_abs(r, a, b);
+        if (aneg && !r.isZero()) r.neg = !r.neg;
+    }
+}
+
+void jia_to(BigInt& r, const BigInt& a, const BigInt& b)
+{
+    add_signed(r, a, b, b.neg);
+}
+
+void jian_to(BigInt& r, const BigInt& a, const BigInt& b)
+{
+    add_signed(r, a, b, !b.neg);
+}
+
+void cheng_to(BigInt& r, const BigInt& a, const BigInt& b)
+{
+    if (a.isZero() || b.isZero())
+    {
+        r.d.clear();
+        r.neg = false;
+        return;
+    }
+    // 乘法内核要求输出不与输入重叠
+    if (&r == &a || &r == &b)
+    {
+        BigInt t;
+        cheng_to(t, a, b);
+        r = std::move(t);
+        return;
+    }
+
+    r.d.resize(a.size() + b.size());
+    mul(r.d.data(), a.d.data(), a.size(), b.d.data(), b.size());
+    r.neg = a.neg != b.neg;
+    trim(r);
+}
+
+void square_to(BigInt& r, const BigInt& a)
+{
+    if (a.isZero())
+    {
+        r.d.clear();
+        r.neg = false;
+        return;
+    }
+    if (&r == &a)
+    {
+        BigInt t;
+        square_to(t, a);
+        r = std::move(t);
+        return;
+    }
+
+    r.d.resize(2 * a.size());
+    sqr(r.d.data(), a.d.data(), a.size());
+    r.neg = false;
+    trim(r);
+}
+
+// 快速幂算法：从高位到低位的滑动窗口法。
+// 预先算好底数的奇数次幂，每个窗口只需一次乘法；平方和乘法在两块预留好容量的缓冲区之间交替进行。
+BigInt quick_mi(const BigInt& base, limb exp) {
+    if (exp == 0) return BigInt(1);
+    if (exp == 1) return base;
+
+    // |base| <= 1 时结果就是 0 或 ±1，不必按 bit_length * exp 预留容量
+    size_t base_bits = bit_length(base);
+    if (base_bits <= 1)
+    {
+        BigInt r = base;
+        r.neg = base.neg && (exp & 1);
+        return r;
+    }
+
+    // 指数不超过 64 位，窗口最长取 3
+    int bits = 0;
+    while (bits < LIMB_BITS && (exp >> bits)) bits++;
+    int k = bits <= 8 ? 1 : bits <= 24 ? 2 : 3;
+
+    // odd[i] = base^(2i+1)
+    std::vector<BigInt> odd((size_t)1 << (k - 1));
+    odd[0] = base;
+    if (odd.size() > 1)
+    {
+        BigInt b2;
+        square_to(b2, base);
+        for (size_t i = 1; i < odd.size(); i++) cheng_to(odd[i], odd[i - 1], b2);
+    }
+
+    // |base| < 2^base_bits，结果不超过 base_bits * exp 位；底数至少为 2，多预留不到一倍
+    size_t cap = base_bits * exp / LIMB_BITS + 2;
+    BigInt acc, tmp;
+    acc.d.reserve(cap);
+    tmp.d.reserve(cap);
+
+    bool started = false;
+    for (int i = bits - 1; i >= 0; )
+    {
+        if (!((exp >> i) & 1))
+        {
+            square_to(tmp, acc);
+            acc.d.swap(tmp.d);
+            i--;
+            continue;
+        }
+
+        // 取以 1 结尾、长度不超过 k 的窗口 [j, i]
+        int j = std::max(i - k + 1, 0);
+        while (!((exp >> j) & 1)) j++;
+        const BigInt& w = odd[(size_t)((exp >> j) & (((limb)1 << (i - j + 1)) - 1)) >> 1];
+
+        if (!started)
+        {
+            acc.d.assign(w.d.begin(), w.d.end());
+            started = true;
+        }
+        else
+        {
+            for (int t = i; t >= j; t--)
+            {
+                square_to(tmp, acc);
+                acc.d.swap(tmp.d);
+            }
+            cheng_to(tmp, acc, w);
+            acc.d.swap(tmp.d);
+        }
+        i = j - 1;
+    }
+
+    // 上面只处理绝对值，负底数的奇次幂为负
+    acc.neg = base.neg && (exp & 1);
+    return acc;
+}
+
+const limb MAX_EXPONENT = 100000000;
+const limb MAX_POW_BITS = (limb)NTT_MAX_LEN * 16;
+
+// 检查 a^b 能否计算：可以时返回 NULL，否则返回错误信息
+const char* mi_check(const BigInt& a, const BigInt& b)
+{
+    if (b.neg) return "错误：指数不能为负数！";
+    if (b.isZero() || a.isZero()) return NULL;
+    if (b.size() == 1 && b.d[0] == 1) return NULL;
+
+    // 按结果的二进制位数估算规模，NTT 乘法能处理的上限之内都允许计算
+    size_t abits = bit_length(a);
+    if (b.size() > 1 || b.d[0] > MAX_EXPONENT || (abits - 1) * b.d[0] + 1 > MAX_POW_BITS) {
+        return "错误：指数太大，无法计算！";
+    }
+    return NULL;
+}
+
+// 调用前须经 mi_check 检查
+BigInt mi_optimized(const BigInt& a, const BigInt& b)
+{
+    if (b.isZero()) {
+        return BigInt(1);
+    }
+
+    if (a.isZero()) {
+        return BigInt();
+    }
+
+    return quick_mi(a, b.d[0]);
+}
+
+// q = a / b，r = a % b；q、r 由调用者提供，不能与 a、b 是同一个对象。
+// 商向零取整，余数与被除数同号，即 a = q*b + r 且 |r| < |b|。
+void chu_to(BigInt& q, BigInt& r, const BigInt& a, const BigInt& b)
+{
+    int cmp = check(a, b);
+    if (cmp == 1)
+    {
+        q.d.clear();
+        r.d = a.d;
+    }
+    else if (cmp == 0)
+    {
+        q.d.assign(1, 1);
+        r.d.clear();
+    }
+    else if (b.size() == 1)
+    {
+        // 单肢除数：一遍扫描的短除法
+        q.d.resize(a.size());
+        limb rem = divrem_1(q.d.data(), a.d.data(), a.size(), b.d[0]);
+        r.d.assign(1, rem);
+    }
+    else
+    {
+        q.d.resize(a.size() - b.size() + 1);
+        r.d.resize(b.size());
+        divrem(q.d.data(), r.d.data(), a.d.data(), a.size(), b.d.data(), b.size());
+    }
+
+    q.neg = a.neg != b.neg;
+    r.neg = a.neg;
+    trim(q);
+    trim(r);
+}
+
+// ---------- 字长快速路径 ----------
+// 两个操作数都能放进一个 64 位字时，直接在 uint64_t / unsigned __int128 上计算，
+// 省掉十进制转换、BigInt 分派和打印时的多精度除法。
+// 加、减、乘、除的结果一定放得下 128 位，只有乘方可能溢出，溢出时交回 BigInt 路径。
+
+// s 满足 is_number；绝对值超过 2^64-1 时返回 false
+bool parse_word(const std::string& s, limb& v, bool& neg)
+{
+    neg = s[0] == '-';
+    if (s.size() - neg > 20) return false;
+    v = 0;
+    for (size_t i = neg; i < s.size(); i++)
+    {
+        if (__builtin_mul_overflow(v, (limb)10, &v)) return false;
+        if (__builtin_add_overflow(v, (limb)(s[i] - '0'), &v)) return false;
+    }
+    return true;
+}
+
+// 操作数按符号和绝对值给出。算出结果并追加到 out 时返回 true；
+// 返回 false 时 out 不变，由调用者改走 BigInt 路径
+bool eval_word(std::string& out, char op, limb x, bool xneg, limb y, bool yneg)
+{
+    switch (op)
+    {
+    case '-':
+        yneg = !yneg;
+        // 减去 y 即加上 -y，落到加法
+        CALC_FALLTHROUGH;
+    case '+':
+        if (xneg == yneg) append_u128(out, (dlimb)x + y, xneg);
+        else if (x >= y) append_u128(out, x - y, xneg);
+        else append_u128(out, y - x, yneg);
+        return true;
+    case '*':
+        append_u128(out, (dlimb)x * y, xneg != yneg);
+        return true;
+    case '/':
+        if (y == 0) return false;   // 报错统一在 BigInt 路径里给出
+        append_u128(out, x / y, xneg != yneg);
+        out += "......";
+        append_u128(out, x % y, xneg);
+        return true;
+    case '^':
+    {
+        // 负指数的报错、大指数的警告都交给 BigInt 路径
+        if ((yneg && y) || y > 1000) return false;
+        dlimb r = 1, w = x;
+        for (limb e = y; e; e >>= 1)
+        {
+            if ((e & 1) && __builtin_mul_overflow(r, w, &r)) return false;
+            if (e > 1 && __builtin_mul_overflow(w, w, &w)) return false;
+        }
+        append_u128(out, r, xneg && (y & 1));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// ---------- 表达式求值 ----------
+// 解析并计算一条完整的表达式，结果或错误信息以文本形式追加到调用者的字符串里，
+// 自身不向 std::cout 输出任何东西，交互模式和批处理模式共用。
+//
+// 语法用优先级爬升法解析成语法树，中间结果全程以 BigInt 保存，只有最终结果转成十进制：
+//   + -        优先级最低，左结合
+//   * / %      左结合；/ 为向零取整的商，% 为与被除数同号的余数
+//   一元负号   如 -(2+3)，作用到其后的一个 ^ 为止，即 -2^2 = -(2)^2 = -4，2*-3^2 = -18
+//   ^          优先级最高，右结合，2^3^2 = 2^9
+// 负号紧贴数字且数字后面不是 ^ 时直接读成负数，如 -12*-34 = 408、2^-1，省掉一个一元负号结点。
+// 整条表达式的最外层运算是 / 时照旧输出“商......余数”。
+//
+// 结点按后序存进数组，子结点的下标总比父结点小，求值时从前往后扫一遍即可，不需要递归。
+//
+// 求值前先对语法树做一遍优化：
+//   1. 按 (运算符, 子结点) 给每棵子树建哈希键，相同的子树只算一次，结果被引用几次就保留到最后一次用完；
+//      + 和 * 的两个子结点排好序，a*b 与 b*a 也算相同
+//   2. 连乘展平成一串因子，同底的因子合并：x*x 变成平方，x^a*x^b 变成 x^(a+b)，x*x^a 变成 x^(a+1)
+//   3. 剩下的因子每次取最短的两个相乘，避免一个越乘越长的数反复去乘短数
+// 合并后的指数超出 mi_check 的上限时退回逐个乘方再相乘，报错信息和出错顺序与不优化时一致。
+
+enum EvalStatus
+{
+    EVAL_OK,
+    EVAL_SYNTAX_ERROR,   // 表达式格式不对，没有可计算的内容
+    EVAL_MATH_ERROR      // 格式正确但无法计算，如除数为 0、指数太大
+};
+
+// 括号、一元负号和连续乘方的最大嵌套层数，防止解析时递归过深
+const int MAX_EXPR_DEPTH = 1000;
+
+struct ExprNode
+{
+    char op;            // 0 为数字，'~' 为一元负号，其余为二元运算符
+    size_t lhs, rhs;    // 子结点下标，一元负号只用 lhs
+    size_t pos, len;    // 数字在表达式里的位置
+    BigInt value;
+
+    // 以下由优化阶段填写
+    bool dead;          // 与前面某棵子树相同，不再计算
+    bool lazy;          // 被并进上层的连乘，不单独计算
+    size_t chain;       // 连乘的根结点在 chains 里的下标
+    size_t uses;        // 还有几处要用到这个结点的值
+};
+
+// 结点下标的空值
+const size_t NO_NODE = (size_t)-1;
+
+// 运算符在 EXPR_OPS 里的位置即它的编号，不超过 7
+const char EXPR_OPS[] = "~+-*/%^";
+
+// 运算结点的哈希键：(子结点下标 * 8 + 运算符编号, 另一个子结点下标)
+typedef std::pair<size_t, size_t> NodeKey;
+
+struct NodeKeyHash
 {
-    if (a.size() > b.size()) return -1;
-    if (a.size() < b.size()) return 1;
-    for (int i = a.size() - 1; i >= 0; i--)
+    size_t operator()(const NodeKey& k) const
     {
-        if (a[i] > b[i]) return -1;
-        if (a[i] < b[i]) return 1;
+        return std::hash<size_t>()(k.first * 0x9E3779B97F4A7C15ULL ^ k.second);
     }
-    return 0;
-}
+};
 
-void print(const std::vector<int>& a, bool b, bool c)
+// 连乘里同底的一组因子：base^(count + exps 的和)
+struct PowGroup
 {
-    if (a.empty()) {
-        std::cout << "0";
-        if (c) std::cout << "\n\n";
-        return;
-    }
+    size_t base;
+    limb count;
+    std::vector<size_t> exps;
+};
 
-    if (a.back() == -1 && !a.empty()) {
-        std::vector<int> temp = a;
-        temp.pop_back();
-        std::cout << '-';
-        print(temp, b, false);
-        if (c) std::cout << "\n\n";
-        return;
-    }
+class Evaluator
+{
+public:
+    // 大指数乘方开始前的提示，为 NULL 时不提示
+    void (*warn)(const std::string& msg);
 
-    if (b)
+    Evaluator() : warn(NULL), pos(0), depth(0) {}
+
+    // 只解析不计算；失败时错误信息追加到 out
+    EvalStatus parse(const std::string& s, std::string& out)
     {
-        for (int i = a.size() - 1; i >= 0; i--)
+        src = s;
+        pos = 0;
+        depth = 0;
+        nodes.clear();
+        err = NULL;
+        bad_op = 0;
+
+        skip_space();
+        if (pos == src.size()) {
+            out += "错误：无效的表达式！";
+            return EVAL_SYNTAX_ERROR;
+        }
+
+        bool ok = parse_expr(1);
+        if (ok && pos < src.size())
         {
-            std::cout << a[i];
+            // 顶层只会因为多出来的右括号提前停下
+            err = "错误：括号不匹配！";
+            ok = false;
         }
+        if (!ok) {
+            if (bad_op) {
+                out += "错误：不支持的操作符 '";
+                out += bad_op;
+                out += "'";
+            } else {
+                out += err;
+            }
+            return EVAL_SYNTAX_ERROR;
+        }
+        return EVAL_OK;
     }
-    else
+
+    // 计算上一次 parse 成功的表达式
+    EvalStatus compute(std::string& out)
     {
-        for (int i = 0; i < a.size(); i++)
+        // 只有“数字 运算符 数字”且两个操作数都是字长时先走快速路径，溢出或不认识的操作符再转成 BigInt
+        if (nodes.size() == 3 && nodes[0].op == 0 && nodes[1].op == 0)
         {
-            std::cout << a[i];
+            limb x, y;
+            bool xneg, yneg;
+            if (parse_word(literal(nodes[0]), x, xneg) && parse_word(literal(nodes[1]), y, yneg) &&
+                eval_word(out, nodes[2].op, x, xneg, y, yneg)) return EVAL_OK;
         }
-    }
 
-    if (c) std::cout << "\n\n";
-    std::cout.flush();
-}
+        optimize();
 
-std::vector<int> jia(const std::vector<int>& a, const std::vector<int>& b)
-{
-    std::vector<int> c(std::max(a.size(), b.size()) + 1, 0);
-    for (int i = 0; i < std::max(a.size(), b.size()); i++)
-    {
-        int r = 0;
-        if (i < a.size()) r += a[i];
-        if (i < b.size()) r += b[i];
-        c[i] += r;
-        if (c[i] > 9)
+        size_t root = nodes.size() - 1;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            ExprNode& n = nodes[i];
+            if (n.dead) continue;
+            if (n.op == 0)
+            {
+                n.value = from_dec(literal(n));
+                continue;
+            }
+
+            BigInt& a = nodes[n.lhs].value;
+            BigInt& b = nodes[n.rhs].value;
+            if (n.lazy)
+            {
+                // 乘方推迟到连乘的根结点再算，能否计算照旧在这里检查，报错顺序不变
+                const char* e = n.op == '^' ? mi_check(a, b) : NULL;
+                if (e) {
+                    out += e;
+                    return EVAL_MATH_ERROR;
+                }
+                continue;
+            }
+            if (n.chain != NO_NODE)
+            {
+                eval_chain(n);
+                continue;
+            }
+            if (n.op == '~')
+            {
+                take(n.value, n.lhs);
+                if (!n.value.isZero()) n.value.neg = !n.value.neg;
+                continue;
+            }
+
+            switch (n.op)
+            {
+            case '+':
+            case '-':
+                // 左操作数最后一次被用到时就地改写并接管它的内存
+                if (nodes[n.lhs].uses == 1 && n.lhs != n.rhs)
+                {
+                    add_signed(a, a, b, n.op == '+' ? b.neg : !b.neg);
+                    n.value = std::move(a);
+                }
+                else
+                {
+                    add_signed(n.value, a, b, n.op == '+' ? b.neg : !b.neg);
+                }
+                break;
+            case '*':
+                if (n.lhs == n.rhs) square_to(n.value, a);
+                else cheng_to(n.value, a, b);
+                break;
+            case '/':
+            case '%':
+                if (b.isZero()) {
+                    out += "错误：除数不能为0！";
+                    return EVAL_MATH_ERROR;
+                }
+                if (n.op == '/') chu_to(n.value, rem, a, b);
+                else chu_to(rem, n.value, a, b);
+                break;
+            case '^':
+            {
+                const char* e = mi_check(a, b);
+                if (e) {
+                    out += e;
+                    return EVAL_MATH_ERROR;
+                }
+                pow_warn(b);
+                n.value = mi_optimized(a, b);
+                break;
+            }
+            }
+            release(n.lhs);
+            release(n.rhs);
+        }
+
+        append_dec(out, nodes[root].value);
+        if (nodes[root].op == '/')
         {
-            c[i + 1] += c[i] / 10;
-            c[i] %= 10;
+            out += "......";
+            append_dec(out, rem);
         }
+        return EVAL_OK;
     }
-    while (c.back() == 0 && c.size() > 1) c.pop_back();
-    return c;
-}
 
-std::vector<int> jian(const std::vector<int>& a, const std::vector<int>& b)
-{
-    bool flag = 0;
-    std::vector<int> aa = a, bb = b;
-    int cmp = check(aa, bb);
-    if (cmp == 1) {
-        std::swap(aa, bb);
-        flag = 1;
-    } else if (cmp == 0) {
-        return {0};
+    EvalStatus run(const std::string& s, std::string& out)
+    {
+        EvalStatus st = parse(s, out);
+        return st == EVAL_OK ? compute(out) : st;
     }
 
-    std::vector<int> c(aa.size(), 0);
-    for (int i = 0; i < aa.size(); i++)
+private:
+    std::string src;
+    size_t pos;
+    int depth;
+    std::vector<ExprNode> nodes;
+    std::vector<std::vector<PowGroup> > chains;
+    const char* err;
+    char bad_op;
+    BigInt rem;
+
+    void pow_warn(const BigInt& e)
     {
-        int res = aa[i];
-        if (i < bb.size()) res -= bb[i];
-        c[i] += res;
-        if (c[i] < 0)
-        {
-            c[i + 1]--;
-            c[i] += 10;
+        if (warn && e.size() == 1 && e.d[0] > 1000) {
+            warn("警告：指数为 " + std::to_string(e.d[0]) + "，计算可能需要一些时间...\n");
         }
     }
-    while (c.back() == 0 && c.size() > 1) c.pop_back();
-    if (flag == 1 && !(c.size() == 1 && c[0] == 0)) c.push_back(-1);
-    return c;
-}
 
-std::vector<int> cheng(const std::vector<int>& a, const std::vector<int>& b)
-{
-    std::vector<int> c(a.size() + b.size(), 0);
-    for (int i = 0; i < a.size(); i++)
+    // 结点 i 的值用掉一次，没有别处再用时释放内存
+    void release(size_t i)
     {
-        for (int j = 0; j < b.size(); j++)
-        {
-            c[i + j] += a[i] * b[j];
-        }
+        if (--nodes[i].uses == 0) nodes[i].value = BigInt();
     }
-    for (int i = 0; i < c.size() - 1; i++)
+
+    // 取出结点 i 的值：最后一次使用时直接接管，否则复制
+    void take(BigInt& dst, size_t i)
     {
-        c[i + 1] += c[i] / 10;
-        c[i] %= 10;
+        if (nodes[i].uses == 1) dst = std::move(nodes[i].value);
+        else dst = nodes[i].value;
+        release(i);
     }
-    while (c.size() > 1 && c.back() == 0) c.pop_back();
-    return c;
-}
 
-// 快速幂算法
-std::vector<int> quick_mi(const std::vector<int>& base, int exp) {
-    if (exp == 0) return {1};
-    if (exp == 1) return base;
+    // 数字去掉前导零后的规范写法，"007" 与 "7"、"-0" 与 "0" 视为相同
+    std::string literal_key(const ExprNode& n) const
+    {
+        size_t p = n.pos, e = n.pos + n.len;
+        bool neg = src[p] == '-';
+        if (neg) p++;
+        while (p + 1 < e && src[p] == '0') p++;
+        std::string key = neg && src[p] != '0' ? "-" : "";
+        key.append(src, p, e - p);
+        return key;
+    }
+
+    void optimize()
+    {
+        size_t n = nodes.size();
+        chains.clear();
 
-    std::vector<int> half = quick_mi(base, exp / 2);
-    std::vector<int> result = cheng(half, half);
+        // 只有一个运算时没有可合并的子树，不值得建哈希表，只需把 x*x 认成平方
+        if (n <= 3)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                ExprNode& x = nodes[i];
+                x.dead = x.lazy = false;
+                x.chain = NO_NODE;
+                x.uses = 0;
+                if (x.op == 0) continue;
+                if (x.op == '~') x.rhs = x.lhs;
+                else if (x.op == '*' && nodes[x.lhs].op == 0 && nodes[x.rhs].op == 0 &&
+                         literal_key(nodes[x.lhs]) == literal_key(nodes[x.rhs]))
+                {
+                    nodes[x.rhs].dead = true;
+                    x.rhs = x.lhs;
+                }
+                nodes[x.lhs].uses++;
+                if (x.op != '~') nodes[x.rhs].uses++;
+            }
+            nodes[n - 1].uses++;
+            return;
+        }
 
-    if (exp % 2 == 1) {
-        result = cheng(result, base);
-    }
+        // 1. 公共子表达式：结点按后序排列，子结点已经换成各自的代表，所以键里只需写子结点下标；
+        //    数字按规范写法查重
+        std::unordered_map<std::string, size_t> seen_num;
+        std::unordered_map<NodeKey, size_t, NodeKeyHash> seen_op;
+        seen_op.reserve(n);
+        std::vector<size_t> rep(n);
+        std::vector<size_t> parent(n, NO_NODE);
+        for (size_t i = 0; i < n; i++)
+        {
+            ExprNode& x = nodes[i];
+            x.dead = x.lazy = false;
+            x.chain = NO_NODE;
+            x.uses = 0;
 
-    return result;
-}
+            size_t first;
+            if (x.op == 0) first = seen_num.insert(std::make_pair(literal_key(x), i)).first->second;
+            else
+            {
+                x.lhs = rep[x.lhs];
+                x.rhs = x.op == '~' ? x.lhs : rep[x.rhs];
+                if ((x.op == '+' || x.op == '*') && x.lhs > x.rhs) std::swap(x.lhs, x.rhs);
+                size_t code = std::strchr(EXPR_OPS, x.op) - EXPR_OPS;
+                first = seen_op.insert(std::make_pair(NodeKey(x.lhs * 8 + code, x.rhs), i)).first->second;
+            }
+            rep[i] = first;
+            if (first != i)
+            {
+                x.dead = true;
+                continue;
+            }
 
-std::vector<int> mi_optimized(const std::vector<int>& a, const std::vector<int>& b)
-{
-    if (b.size() == 1 && b[0] == 0) {
-        return {1};
-    }
+            if (x.op == 0) continue;
+            nodes[x.lhs].uses++;
+            parent[x.lhs] = i;
+            if (x.op != '~')
+            {
+                nodes[x.rhs].uses++;
+                parent[x.rhs] = i;
+            }
+        }
+        nodes[n - 1].uses++;   // 根结点的值最后要输出
+
+        // 2. 只被一个乘法用到的乘法、乘方并进上层的连乘
+        for (size_t i = 0; i < n; i++)
+        {
+            ExprNode& x = nodes[i];
+            if (x.dead || (x.op != '*' && x.op != '^')) continue;
+            x.lazy = x.uses == 1 && parent[i] != NO_NODE && nodes[parent[i]].op == '*';
+        }
+
+        // 3. 每条连乘的根结点把因子按底数分组
+        std::unordered_map<size_t, size_t> group;
+        std::vector<size_t> stack;
+        for (size_t i = 0; i < n; i++)
+        {
+            ExprNode& x = nodes[i];
+            if (x.dead || x.lazy || x.op != '*') continue;
 
-    if (a.size() == 1 && a[0] == 0) {
-        return {0};
+            x.chain = chains.size();
+            chains.push_back(std::vector<PowGroup>());
+            std::vector<PowGroup>& g = chains.back();
+            group.clear();
+            stack.assign(1, x.rhs);
+            stack.push_back(x.lhs);
+            while (!stack.empty())
+            {
+                size_t c = stack.back();
+                stack.pop_back();
+                const ExprNode& f = nodes[c];
+                if (f.lazy && f.op == '*')
+                {
+                    stack.push_back(f.rhs);
+                    stack.push_back(f.lhs);
+                    continue;
+                }
+
+                size_t base = f.lazy ? f.lhs : c;
+                std::pair<std::unordered_map<size_t, size_t>::iterator, bool> it = group.insert(std::make_pair(base, g.size()));
+                if (it.second)
+                {
+                    PowGroup pg;
+                    pg.base = base;
+                    pg.count = 0;
+                    g.push_back(pg);
+                }
+                PowGroup& pg = g[it.first->second];
+                if (f.lazy) pg.exps.push_back(f.rhs);
+                else pg.count++;
+            }
+        }
     }
 
-    if (b.size() == 1 && b[0] == 1) {
-        return a;
+    // 计算连乘的根结点 n：先算出每组同底因子的幂，再每次取最短的两个相乘。
+    // 每个因子和中间乘积都放在 parts 里，堆中存 (肢数, 在 parts 里的下标)，肢数相同时按下标先后取
+    void eval_chain(ExprNode& n)
+    {
+        const std::vector<PowGroup>& g = chains[n.chain];
+        std::vector<BigInt> parts;
+        parts.reserve(2 * g.size());   // 各组的幂加上中间乘积，一次预留够，中间不再搬家
+        typedef std::pair<size_t, size_t> Factor;
+        std::priority_queue<Factor, std::vector<Factor>, std::greater<Factor> > heap;
+
+        for (size_t k = 0; k < g.size(); k++)
+        {
+            const PowGroup& pg = g[k];
+            const BigInt& x = nodes[pg.base].value;
+            parts.push_back(BigInt());
+            BigInt& p = parts.back();
+            if (pg.exps.empty() && pg.count == 1) take(p, pg.base);
+            else if (pg.exps.empty())
+            {
+                if (pg.count == 2) square_to(p, x);
+                else p = quick_mi(x, pg.count);
+            }
+            else
+            {
+                BigInt e(pg.count);
+                for (size_t j = 0; j < pg.exps.size(); j++) jia_to(e, e, nodes[pg.exps[j]].value);
+                if (!mi_check(x, e))
+                {
+                    pow_warn(e);
+                    p = mi_optimized(x, e);
+                }
+                else
+                {
+                    // 合并后的指数超出上限时退回逐个乘方再相乘
+                    p = quick_mi(x, pg.count);
+                    for (size_t j = 0; j < pg.exps.size(); j++)
+                    {
+                        pow_warn(nodes[pg.exps[j]].value);
+                        cheng_to(p, p, mi_optimized(x, nodes[pg.exps[j]].value));
+                    }
+                }
+            }
+            heap.push(Factor(p.size(), parts.size() - 1));
+        }
+
+        while (heap.size() > 1)
+        {
+            size_t u = heap.top().second;
+            heap.pop();
+            size_t v = heap.top().second;
+            heap.pop();
+            parts.push_back(BigInt());
+            cheng_to(parts.back(), parts[u], parts[v]);
+            heap.push(Factor(parts.back().size(), parts.size() - 1));
+        }
+        n.value = std::move(parts[heap.top().second]);
+
+        for (size_t k = 0; k < g.size(); k++)
+        {
+            if (g[k].exps.empty() && g[k].count == 1) continue;   // 单个因子在 take 时已经释放
+            for (limb c = 0; c < g[k].count + g[k].exps.size(); c++) release(g[k].base);
+            for (size_t j = 0; j < g[k].exps.size(); j++) release(g[k].exps[j]);
+        }
     }
 
-    int exp = 0;
-    for (int i = b.size() - 1; i >= 0; i--) {
-        exp = exp * 10 + b[i];
-        if (exp > 1000000) {
-            std::cout << "错误：指数太大，无法计算！\n";
-            return {0};
+    // 二元运算符的优先级，不是二元运算符时返回 0
+    static int precedence(char ch)
+    {
+        switch (ch)
+        {
+        case '+':
+        case '-':
+            return 1;
+        case '*':
+        case '/':
+        case '%':
+            return 2;
+        case '^':
+            return 4;
+        default:
+            return 0;
         }
     }
 
-    if (exp > 1000) {
-        std::cout << "警告：指数为 " << exp << "，计算可能需要一些时间...\n";
+    // 一元负号介于 * / % 与 ^ 之间
+    static const int UNARY_PRECEDENCE = 3;
+
+    std::string literal(const ExprNode& n) const
+    {
+        return src.substr(n.pos, n.len);
     }
 
-    return quick_mi(a, exp);
-}
+    void skip_space()
+    {
+        while (pos < src.size() && isspace((unsigned char)src[pos])) pos++;
+    }
 
-std::pair<std::vector<int>, std::vector<int> > chu(const std::vector<int>& a, const std::vector<int>& b)
-{
-    if (b[0] == 0 && b.size() == 1) {
-        std::cout << "错误：除数不能为0！\n";
-        return {{0}, {0}};
+    void add_node(char op, size_t lhs, size_t rhs)
+    {
+        nodes.push_back(ExprNode());
+        ExprNode& n = nodes.back();
+        n.op = op;
+        n.lhs = lhs;
+        n.rhs = rhs;
+        n.pos = n.len = 0;
     }
-    if (a[0] == 0 && a.size() == 1) return {{0}, {0}};
-    int cmp = check(a, b);
-    if (cmp == 1) return {{0}, a};
-    if (cmp == 0) return {{1}, {0}};
 
-    std::vector<int> q(a.size(), 0);
-    std::vector<int> res;
-    res.push_back(0);
+    // 解析一段只含优先级不低于 min_prec 的二元运算符的表达式，根结点为 nodes.back()。
+    // 每进入一层子表达式(括号、一元负号、二元运算符的右侧)递归一次，左结合的长链不会越递归越深
+    bool parse_expr(int min_prec)
+    {
+        if (depth >= MAX_EXPR_DEPTH) {
+            err = "错误：表达式嵌套太深！";
+            return false;
+        }
+        depth++;
+        bool ok = parse_chain(min_prec);
+        depth--;
+        return ok;
+    }
 
-    for (int i = a.size() - 1; i >= 0; i--)
+    bool parse_chain(int min_prec)
     {
-        res.insert(res.begin(), a[i]);
-        while (res.back() == 0 && res.size() > 1) res.pop_back();
-        int l = 0, r = 9;
-        while (l <= r)
+        if (!parse_operand()) return false;
+        while (true)
         {
-            int mid = (l + r) / 2;
-            std::vector<int> m(1, mid);
-            std::vector<int> t = cheng(m, b);
-            int cmp = check(res, t);
-            if (cmp == -1 || cmp == 0)
-            {
-                l = mid + 1;
-            }
-            else
+            skip_space();
+            if (pos == src.size() || src[pos] == ')') return true;
+
+            char ch = src[pos];
+            int prec = precedence(ch);
+            if (prec == 0)
             {
-                r = mid - 1;
+                if (isdigit((unsigned char)ch) || ch == '(') err = "错误：无效的表达式！";
+                else bad_op = ch;
+                return false;
             }
+            if (prec < min_prec) return true;
+            pos++;
+
+            // 左结合的运算符右边只收更高一级的运算，右结合的 ^ 连同级的也一起收
+            size_t lhs = nodes.size() - 1;
+            if (!parse_expr(ch == '^' ? prec : prec + 1)) return false;
+            add_node(ch, lhs, nodes.size() - 1);
+        }
+    }
+
+    // pos 处的 '-' 后面紧跟数字，且这个数字后面不是 ^ 时，'-' 属于数字本身
+    bool negative_literal() const
+    {
+        size_t i = pos + 1;
+        if (i == src.size() || !isdigit((unsigned char)src[i])) return false;
+        while (i < src.size() && isdigit((unsigned char)src[i])) i++;
+        while (i < src.size() && isspace((unsigned char)src[i])) i++;
+        return i == src.size() || src[i] != '^';
+    }
+
+    // 数字、括号或一元负号
+    bool parse_operand()
+    {
+        skip_space();
+        if (pos == src.size() || (precedence(src[pos]) > 0 && src[pos] != '-') || src[pos] == ')') {
+            err = "错误：数字不能为空！";
+            return false;
         }
-        int t = r;
-        q[i] = t;
-        if (t > 0)
+
+        char ch = src[pos];
+        bool ok;
+        if (ch == '-' && !negative_literal())
+        {
+            pos++;
+            ok = parse_expr(UNARY_PRECEDENCE);
+            if (ok) add_node('~', nodes.size() - 1, 0);
+            return ok;
+        }
+        if (ch == '(')
         {
-            std::vector<int> pp(1, t);
-            std::vector<int> pro = cheng(b, pp);
-            res = jian(res, pro);
+            pos++;
+            ok = parse_expr(1);
+            if (ok && (pos == src.size() || src[pos] != ')')) {
+                err = "错误：括号不匹配！";
+                ok = false;
+            }
+            pos++;
+            return ok;
         }
+
+        size_t start = pos;
+        if (ch == '-') pos++;
+        while (pos < src.size() && isdigit((unsigned char)src[pos])) pos++;
+        if (pos == start) {
+            err = "错误：无效的表达式！";
+            return false;
+        }
+        add_node(0, 0, 0);
+        nodes.back().pos = start;
+        nodes.back().len = pos - start;
+        return true;
     }
-    while (q.back() == 0 && q.size() > 1) q.pop_back();
-    while (res.back() == 0 && res.size() > 1) res.pop_back();
-    return {q, res};
-}
+};
 
 // ============================================
 // 界面函数
@@ -429,11 +3776,18 @@ void usage()
     std::cout << "# 例：1234+5678                           #\n";
     std::cout << "#      /  |  \\                            #\n";
     std::cout << "#  数字1 符号 数字2                       #\n";
+    std::cout << "# 也可以是带括号的多步运算：              #\n";
+    std::cout << "# 例：(12+34)*5^6-7                       #\n";
     std::cout << "###########################################\n";
     std::cout << "# 支持的运算:                             #\n";
     std::cout << "# +(加法)                         -(减法) #\n";
     std::cout << "# *(乘法)                         /(除法) #\n";
-    std::cout << "# ^(幂运算)                               #\n";
+    std::cout << "# ^(幂运算)                       %(取余) #\n";
+    std::cout << "# 数字可以带负号，例：-12*-34             #\n";
+    std::cout << "# 优先级：^ 最高，其次 * / %，最后 + -    #\n";
+    std::cout << "# ^ 从右往左算，其余从左往右算            #\n";
+    std::cout << "# 负号比 ^ 低一级，例：-2^2 = -4          #\n";
+    std::cout << "# 整个式子最后一步是 / 时同时输出余数     #\n";
     std::cout << "###########################################\n";
     std::cout << "# 指令：                                  #\n";
     std::cout << "# exit                               退出 #\n";
@@ -445,6 +3799,13 @@ void usage()
     std::cout << "# allocations                查看内存分配 #\n";
 	std::cout << "# information                查看作者信息 #\n";
     std::cout << "# test                      内存测试示例  #\n";
+    std::cout << "# cpu                        查看运算内核 #\n";
+    std::cout << "###########################################\n";
+    std::cout << "# 启动参数：                              #\n";
+    std::cout << "# -b [文件]   批处理，每行一条表达式      #\n";
+    std::cout << "# -j N               批处理使用 N 个线程  #\n";
+    std::cout << "# -b 时按行并行，单行内部不再多线程；     #\n";
+    std::cout << "# 单条超大的表达式请加 -j 1               #\n";
     std::cout << "###########################################\n\n";
 }
 
@@ -528,7 +3889,6 @@ void log()
 	std::cout << "###########################################\n";
 
     std::cout << "\n按Enter键继续...";
-    std::cin.ignore();
     std::cin.get();
 }
 
@@ -603,8 +3963,255 @@ void testMemory() {
 // 主函数
 // ============================================
 
-int main()
+// 交互模式下大指数乘方的提示直接打到屏幕上，让用户知道要等一会儿
+void warn_to_console(const std::string& msg)
+{
+    std::cout << msg;
+}
+
+// 批处理模式每攒够这么多字节的结果写出一次
+const size_t BATCH_FLUSH_BYTES = (size_t)1 << 20;
+
+// 只含空白字符的行当作空行
+bool blank_line(const std::string& s)
+{
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (!isspace((unsigned char)s[i])) return false;
+    }
+    return true;
+}
+
+// 去掉首尾的空白字符
+void trim_space(std::string& s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && isspace((unsigned char)s[b])) b++;
+    while (e > b && isspace((unsigned char)s[e - 1])) e--;
+    s = s.substr(b, e - b);
+}
+
+// 批处理模式：每行一条表达式，每条输出一行——结果或错误信息，空行对应空行，输出行与输入行一一对应。
+// 空白由解析器处理：运算符和括号两侧可以有空白，数字中间不行("1 2+3" 报错)。
+// 没有提示符、横幅等任何界面输出，也不做乘方的耗时提示。
+int run_batch(std::istream& in)
+{
+    Evaluator ev;
+    std::string line;
+    std::string& out = g_out.buf();
+    while (std::getline(in, line))
+    {
+        if (!blank_line(line)) ev.run(line, out);
+        out += '\n';
+        if (out.size() >= BATCH_FLUSH_BYTES) g_out.flush();
+    }
+    g_out.flush();
+    return 0;
+}
+
+// ---------- 多线程批处理 ----------
+// 主线程读入若干行打成一个“块”，按序号交给工作线程；每个工作线程有自己的 Evaluator，
+// 把整块的结果写进一个字符串。完成的块放进按序号取模的环形重排缓冲区，
+// 主线程按序号依次取出写到 g_out，所以输出顺序与输入完全一致。
+// 在途的块数有上限，读得再快内存也不会无限增长。
+
+// 一块最多这么多行或这么多字节，先到为准：小表达式成批分摊同步开销，超长的表达式自成一块
+const size_t BATCH_CHUNK_LINES = 1024;
+const size_t BATCH_CHUNK_BYTES = (size_t)1 << 16;
+
+class ParallelBatch
+{
+public:
+    explicit ParallelBatch(unsigned threads)
+        : slots(4 * (size_t)threads), ready(4 * (size_t)threads, false),
+          next_submit(0), next_take(0), next_emit(0), eof(false)
+    {
+        jobs.resize(slots.size());
+        for (unsigned i = 0; i < threads; i++) workers.push_back(std::thread(&ParallelBatch::work, this));
+    }
+
+    ~ParallelBatch()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            eof = true;
+        }
+        has_job.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    int run(std::istream& in)
+    {
+        std::string line;
+        std::vector<std::string> chunk;
+        size_t bytes = 0;
+        bool more = true;
+        while (more)
+        {
+            more = static_cast<bool>(std::getline(in, line));
+            if (more)
+            {
+                bytes += line.size();
+                chunk.push_back(std::move(line));
+                line.clear();
+            }
+            if (chunk.empty() || (more && chunk.size() < BATCH_CHUNK_LINES && bytes < BATCH_CHUNK_BYTES)) continue;
+
+            submit(chunk);
+            chunk.clear();
+            bytes = 0;
+        }
+
+        // 等所有块完成并写出
+        std::unique_lock<std::mutex> lock(mu);
+        while (next_emit < next_submit)
+        {
+            done.wait(lock, [this] { return ready[next_emit % slots.size()]; });
+            emit(lock);
+        }
+        lock.unlock();
+        g_out.flush();
+        return 0;
+    }
+
+private:
+    std::vector<std::vector<std::string> > jobs;   // 环形缓冲：序号 i 的输入在 jobs[i % n]
+    std::vector<std::string> slots;                 // 序号 i 的输出在 slots[i % n]
+    std::vector<bool> ready;
+    size_t next_submit, next_take, next_emit;
+    bool eof;
+    std::mutex mu;
+    std::condition_variable has_job, done;
+    std::vector<std::thread> workers;
+
+    void submit(std::vector<std::string>& chunk)
+    {
+        std::unique_lock<std::mutex> lock(mu);
+        // 在途块数到了上限就先把已完成的按序写出，腾出位置
+        while (next_submit - next_emit == slots.size())
+        {
+            done.wait(lock, [this] { return ready[next_emit % slots.size()]; });
+            emit(lock);
+        }
+        jobs[next_submit % slots.size()].swap(chunk);
+        next_submit++;
+        has_job.notify_one();
+
+        // 顺手写出已经完成的块，结果不必等到缓冲区满才出现
+        emit(lock);
+    }
+
+    // 持锁进入；把从 next_emit 起连续完成的块交给 g_out，写的时候不持锁
+    void emit(std::unique_lock<std::mutex>& lock)
+    {
+        while (next_emit < next_submit && ready[next_emit % slots.size()])
+        {
+            size_t k = next_emit % slots.size();
+            std::string out;
+            out.swap(slots[k]);
+            ready[k] = false;
+            next_emit++;
+
+            lock.unlock();
+            g_out.write(out.data(), out.size());
+            if (g_out.buf().size() >= BATCH_FLUSH_BYTES) g_out.flush();
+            lock.lock();
+        }
+    }
+
+    void work()
+    {
+        Evaluator ev;
+        std::vector<std::string> lines;
+        while (true)
+        {
+            size_t seq;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                has_job.wait(lock, [this] { return eof || next_take < next_submit; });
+                if (next_take == next_submit) return;
+                seq = next_take++;
+                lines.swap(jobs[seq % slots.size()]);
+            }
+
+            std::string out;
+            for (size_t i = 0; i < lines.size(); i++)
+            {
+                if (!blank_line(lines[i])) ev.run(lines[i], out);
+                out += '\n';
+            }
+            lines.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                slots[seq % slots.size()].swap(out);
+                ready[seq % slots.size()] = true;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+void batch_usage(const char* prog)
+{
+    std::fprintf(stderr, "用法：%s [-b|--batch [-j 线程数] [文件]]\n", prog);
+    std::fprintf(stderr, "批处理默认按行并行，单行内部的运算只用一个线程；单条超大的表达式请加 -j 1\n");
+}
+
+int main(int argc, char* argv[])
 {
+    // -b / --batch [-j N] [文件]：批处理模式，不给文件时读标准输入；
+    // -j / --threads 指定工作线程数，默认取 CPU 核数，为 1 时在主线程里逐行计算
+    if (argc > 1)
+    {
+        std::string flag = argv[1];
+        if (flag != "-b" && flag != "--batch")
+        {
+            batch_usage(argv[0]);
+            return 1;
+        }
+
+        unsigned threads = std::thread::hardware_concurrency();
+        const char* file = NULL;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+            {
+                threads = (unsigned)std::strtoul(argv[++i], NULL, 10);
+                if (threads == 0) {
+                    batch_usage(argv[0]);
+                    return 1;
+                }
+            }
+            else if (!file && arg[0] != '-') file = argv[i];
+            else
+            {
+                batch_usage(argv[0]);
+                return 1;
+            }
+        }
+        if (threads == 0) threads = 1;
+
+        std::ios::sync_with_stdio(false);
+        std::ifstream fin;
+        if (file)
+        {
+            fin.open(file);
+            if (!fin) {
+                std::fprintf(stderr, "错误：无法打开文件 %s\n", file);
+                return 1;
+            }
+        }
+        std::istream& in = file ? static_cast<std::istream&>(fin) : std::cin;
+
+        if (threads == 1) return run_batch(in);
+        // 批处理已经按行并行，乘法内部不再分叉，免得再起一个同样大小的任务池
+        g_par.threads = 1;
+        ParallelBatch pb(threads);
+        return pb.run(in);
+    }
+
     system("title 简易计算器 v4.2(内存管理版)");
 
     // 启动内存管理器
@@ -612,13 +4219,20 @@ int main()
 
     start();
 
+    Evaluator ev;
+    ev.warn = warn_to_console;
+
     while (1)
     {
-        char op;
+        // 上一条表达式的结果在这里一次写出
+        g_out.flush();
+
+        // 整行读入，去掉首尾空白后再匹配指令或交给 Evaluator，与批处理模式解析同样的文本
         std::string s;
-        std::string s1, s2;
         std::cout << "输入表达式或指令: ";
-        std::cin >> s;
+        if (!std::getline(std::cin, s)) s = "exit";
+        trim_space(s);
+        if (s.empty()) continue;
 
         if (s == "exit") {
             std::cout << "\n正在退出程序...\n";
@@ -667,72 +4281,23 @@ int main()
 			information();
 			continue;
 		}
-
-        int n = -1, m = -1;
-        for (size_t i = 0; i < s.size(); i++)
+        if (s == "cpu")
         {
-            if (!isdigit(s[i]))
-            {
-                op = s[i];
-                n = i;
-                m = i + 1;
-                break;
-            }
-        }
-
-        if (n == -1) {
-            std::cout << "错误：无效的表达式！\n";
+            std::cout << "当前运算内核: " << g_kernels.name << "\n";
+            std::cout << "并行线程数: " << g_par.threads << "，分叉阈值: " << g_par.cutoff << " 肢\n";
             continue;
         }
 
-        s1 = s.substr(0, n);
-        s2 = s.substr(m);
-
-        if (s1.empty() || s2.empty()) {
-            std::cout << "错误：数字不能为空！\n";
+        std::string& out = g_out.buf();
+        if (ev.parse(s, out) != EVAL_OK) {
+            out += '\n';
             continue;
         }
 
-        std::vector<int> a, b;
-
-        for (int i = s1.size() - 1; i >= 0; i--) a.push_back(s1[i] - '0');
-        for (int i = s2.size() - 1; i >= 0; i--) b.push_back(s2[i] - '0');
-
+        // 先打出等号，大指数的提示紧跟在它后面
         std::cout << '=';
-
-        if (op == '+')
-        {
-            std::vector<int> c = jia(a, b);
-            print(c, 1, 1);
-        }
-        else if (op == '-')
-        {
-            std::vector<int> c = jian(a, b);
-            print(c, 1, 1);
-        }
-        else if (op == '*')
-        {
-            std::vector<int> c = cheng(a, b);
-            print(c, 1, 1);
-        }
-        else if (op == '/')
-        {
-            auto res = chu(a, b);
-            std::vector<int> c = res.first;
-            std::vector<int> d = res.second;
-            print(c, 1, 0);
-            std::cout << "......";
-            print(d, 1, 1);
-        }
-        else if (op == '^')
-        {
-            std::vector<int> c = mi_optimized(a, b);
-            print(c, 1, 1);
-        }
-        else
-        {
-            std::cout << "错误：不支持的操作符 '" << op << "'\n";
-        }
+        if (ev.compute(out) == EVAL_OK) out += "\n\n";
+        else out += '\n';
     }
 
     std::cout << "\n=========================================\n";
@@ -743,7 +4308,6 @@ int main()
 
     std::cout << "\n感谢使用简易计算器 v5.0！\n";
     std::cout << "按Enter键退出...";
-    std::cin.ignore();
     std::cin.get();
 
     return 0;